@@ -9,6 +9,8 @@
 #include <LiquidCrystal.h>
 #include "Arduino.h"
 #include "LCDHelper.h"
+#include "adc_sampler.h"
+#include "VoltageScaling.h"
 
 /*========================+
 | #defines                |
@@ -63,24 +65,25 @@ LiquidCrystal	lcd(rs, en, d4, d5, d6, d7);
 
 
 float GetAverageTemp(uint8_t tempPin, float tempScale, uint8_t samples, uint16_t delayMillis) {
-	int32_t rawTempSum = 0;
-	uint8_t i;
-	for (i = 0; i < samples; i++) {
-		delay(delayMillis);
-		rawTempSum += analogRead(tempPin);
-	}
+	uint32_t rawTempSum = adc_sampler_collect(tempPin, samples, (delayMillis == 0) ? 1000 : 1000 / delayMillis, ADC_SAMPLER_QUIET);
+
 	return rawTempSum / static_cast<float>(samples) * tempScale * 100.0 / 1024.0;
 }
 
 
+// Each sample is read the way the monitor reads the battery: oversampled to
+// 10 + VOLTAGE_EXTRA_BITS bits, timed and dithered with the CPU running, so
+// the scale found here holds for its readings.  Quiet mode would calibrate
+// against a less noisy ADC than the monitor sees, and decimation needs that
+// noise.  Returned in 10 bit counts, with the extra bits as the fraction.
 float GetAverageRawVoltage(uint8_t voltagePin, uint8_t samples, uint16_t delayMillis) {
-	int32_t rawVoltageSum = 0;
-	uint8_t i;
-	for (i = 0; i < samples; i++) {
-		delay(delayMillis);
-		rawVoltageSum += analogRead(voltagePin);
+	uint32_t rawVoltageSum = 0;
+
+	for (uint8_t i = 0; i < samples; i++) {
+		rawVoltageSum += adc_sampler_oversample(voltagePin, VOLTAGE_EXTRA_BITS, (delayMillis == 0) ? 1000 : 1000 / delayMillis, ADC_SAMPLER_TIMED | ADC_SAMPLER_DITHER);
 	}
-	return rawVoltageSum / static_cast<float>(samples);
+
+	return rawVoltageSum / static_cast<float>(samples) / (1 << VOLTAGE_EXTRA_BITS);
 }
 
 
@@ -115,8 +118,10 @@ void setup() {
 
 #ifdef USE_EXTERNALVREF
 	analogReference(EXTERNAL);
+	adc_sampler_begin(EXTERNAL);
 #else
 	analogReference(DEFAULT);
+	adc_sampler_begin(DEFAULT);
 #endif
 
 	Serial.println("Setup completed.");
@@ -143,7 +148,7 @@ void loop() {
 	char buffer[20];
 	float tempSample;
 	float scaledVoltage;
-	uint16_t rawVoltageSample;
+	float rawVoltageSample;
 	uint16_t minutesDisabled;
 	static bool tempSource = true;
 	static bool relayOpen = true;
@@ -151,7 +156,7 @@ void loop() {
 
 	tempSample = GetAverageTemp(TEMP_SENSOR, VREFSCALE(vDivScale), 10, 10);
 
-	rawVoltageSample = round(GetAverageRawVoltage(V5_SENSOR, 3, 5));
+	rawVoltageSample = GetAverageRawVoltage(V5_SENSOR, 3, 1);
 	scaledVoltage = rawVoltageSample * VREFSCALE(vDivScale);
 
 	formatFloat(scaledVoltage, voltStr, 5, 2);
@@ -23,18 +23,26 @@
  */
 
 #include <EEPROM.h>
-#include <Wire.h>
 #include <LiquidCrystal.h>
 #include "Arduino.h"
 #include <avr/sleep.h>
-#include "ds3231.h"
 #include "config.h"
+#ifndef CONFIG_ASYNC_TWI
+#include <Wire.h>
+#endif
+#include "ds3231.h"
+#include "twi_async.h"
 
 #include "DataAcquisitionAndReporting.h"
 #include "LCDHelper.h"
 #include "HourlyDataTypes.h"
 #include "DS3231Helpers.h"
 #include "DateTimeHelpers.h"
+#include "at24c32.h"
+#include "adc_sampler.h"
+#include "VoltageScaling.h"
+#include "VoltageFilter.h"
+#include "TempCompensation.h"
 
 
 /*==========================+
@@ -56,15 +64,24 @@
 	#define DebugFlush()	/*Serial.flush();*/
 #endif
 
+#define VOLTAGE_SAMPLE_RATE		1000				// Hz, so a reading costs 4^VOLTAGE_EXTRA_BITS ms (see VoltageScaling.h)
+
 #ifdef USE_EXTERNALVREF
 	#define VDIV_SCALE		4.477983								//
 	#define VREF VREG * 32 / (32 + VREF_RESISTOR)		//
-	#define VREFSCALE(x)	VREF / 1024.0 * (x)			//
+	#define VREFSCALE(x)	VREF / VOLTAGE_FULL_SCALE * (x)			//
+	#define REFERENCE_VOLTS	VREF
 #else
 	#define VDIV_SCALE		4.718196					//
-	#define VREFSCALE(x)	VREG / 1024.0 * (x)			//
+	#define VREFSCALE(x)	VREG / VOLTAGE_FULL_SCALE * (x)			//
+	#define REFERENCE_VOLTS	VREG
 #endif
 
+//#define BANDGAP_MILLIVOLTS		1100				// this chip's bandgap, if measured on AREF; see CalibrateReference()
+#define REFERENCE_CHECK_SECONDS	600					// how often the ADC reference is re-measured against the bandgap
+#define REFERENCE_SAMPLES		16					// bandgap conversions per measurement
+#define REFERENCE_TOLERANCE		10					// percent off REFERENCE_VOLTS before a measurement is ignored
+
 #define TEMP_SENSOR				A3					// An LM34 thermometer
 #define MODE_SWITCH				A2					// Used as a digital switch in a companion app
 #define V5_SENSOR				A1					// This pin measures the VREF-limited external (battery) voltage
@@ -74,21 +91,32 @@
 #define WAKE_SLEEP_BUTTON		2					// When low, makes 328P go to sleep
 #define LED_PIN					4					// output pin for the LED (to show it is awake)
 
-#define DISABLE_VOLTAGE			12.10
-#define ENABLE_VOLTAGE			12.20
+#define DISABLE_MILLIVOLTS		12100				// at 25 C
+#define ENABLE_MILLIVOLTS		12200				// at 25 C
+#define HISTOGRAM_LOW_MILLIVOLTS	11300			// Span of the hourly voltage histogram, around the thresholds
+#define HISTOGRAM_HIGH_MILLIVOLTS	12900
+#define USE_TEMP_COMPENSATION						// shift both with the DS3231 temperature, see TempCompensation.h
 #define ENABLE_WAIT_MINUTES		2					// <<---- 
-#define BUFF_MAX				256
 #define REPORTING_DELAY_SECONDS	6
+#define DISPLAY_FAHRENHEIT		true				// false shows Celsius
+#define WAKE_INTERVAL_SECONDS	10					// sampling interval near a threshold, and until settled
+#define WAKE_INTERVAL_MIN		2					// the adaptive interval stays between these
+#define WAKE_INTERVAL_MAX		300
+#define WAKE_NEAR_MILLIVOLTS	300					// "near" a threshold
+#define WAKE_SAFETY_FACTOR		4					// samples before a threshold is reached at the current slope
+#define SLEEP_WATCH_PERIOD		SLEEP_WATCH_1S		// how often the battery is glanced at while asleep
+#define DIP_REARM_MILLIVOLTS	100					// how far above the disable threshold the voltage must recover before another dip counts
+#define VOLTAGE_FILTER_SHIFT	2					// EMA alpha of 1/4 after the 5-tap median
 #define BINARY_RELAY			1
 #define PWM_RELAY				2
 #define RELAY_TYPE				PWM_RELAY
 
-#ifdef DATA_HOURS
-	#if !(DATA_HOURS==1 || DATA_HOURS==2 || DATA_HOURS==3 || DATA_HOURS==4 || DATA_HOURS==6 || DATA_HOURS==12 || DATA_HOURS==24)
-		#error "DATA_HOURS must be either 1, 2, 3, 4, 6, 12, or 24."
-	#endif
-#else
-	#error "DATA_HOURS is not defined."
+#if WAKE_INTERVAL_MIN < 2 || WAKE_INTERVAL_MIN > WAKE_INTERVAL_SECONDS || WAKE_INTERVAL_SECONDS > WAKE_INTERVAL_MAX
+	#error "Need 2 <= WAKE_INTERVAL_MIN <= WAKE_INTERVAL_SECONDS <= WAKE_INTERVAL_MAX."
+#endif
+
+#if VOLTAGE_EXTRA_BITS < 0 || VOLTAGE_EXTRA_BITS > ADC_SAMPLER_EXTRA_BITS_MAX
+	#error "VOLTAGE_EXTRA_BITS must be between 0 and 6."
 #endif
 
 #ifdef RELAY_TYPE
@@ -102,6 +130,13 @@
 /*==========================+
 | Local structs				|
 +==========================*/
+#define LOGGED_HOUR_VERSION		1		// bump when LoggedHour or HourlyData changes, so the old log is erased
+
+struct loggedHourStruct {
+	uint32_t	timeClosed;		// epoch when the hour was closed
+	HourlyData	hourlyData;
+};
+typedef struct loggedHourStruct LoggedHour;
 
 
 /*========================+
@@ -115,6 +150,13 @@ static CurrentSample	currentSample;
 static ReportControl	reportControl;
 static SamplingData		samplingData;
 static bool				isOutputRelayClosed = false;		// If not Closed then no power goes through.  If Closed power flows.
+static uint8_t			samplingTimer;
+static uint8_t			hourTimer;
+static uint8_t			recoveryTimer = WAKE_TIMER_NONE;
+static AT24C32Log		hourlyLog;							// every closed hour, kept in the RTC module's EEPROM
+static uint32_t			bandgapConstant = 0;				// reference millivolts times the bandgap sum, 0 if it can't be measured
+static uint16_t			referenceMillivolts;				// the ADC reference as last measured
+static uint32_t			referenceCheckTime;					// epoch of that measurement
 
 const uint8_t	rs = 11, en = 10, d4 = 5, d5 = 6, d6 = 7, d7 = 8;
 LiquidCrystal	lcd(rs, en, d4, d5, d6, d7);
@@ -126,8 +168,15 @@ void doBlink(uint8_t ledPin);
 void DisablePower(SamplingData* samplingData, DateTimeDS3231* now, bool* isRelayClosed, uint8_t powerRelay);
 void EnablePower(SamplingData* samplingData, DateTimeDS3231* now, bool* isRelayClosed, uint8_t powerRelay);
 void SetupRecovery(SamplingData* samplingData, DateTimeDS3231* now, uint8_t recoveryDurationMinutes);
+void CancelRecoveryTimer();
+void CalibrateReference(SamplingData* samplingData, uint32_t now);
+void CheckReference(SamplingData* samplingData, uint32_t now, bool force);
+uint16_t ChooseWakeInterval(SamplingData* samplingData, CurrentSample* currentSample);
+void ArmSleepWatch(SamplingData* samplingData, CurrentSample* currentSample);
+void CompensateThresholds(SamplingData* samplingData, int16_t* quarterDegrees, uint32_t age, uint32_t now);
+void RecordDip(SamplingData* samplingData);
 void RecordTimeDisabled(SamplingData* samplingData, CurrentSample* currentSample);
-void DoWakingTasks(SamplingData * samplingData);
+void DoWakingTasks(SamplingData* samplingData, DS3231Snapshot* rtcSnapshot);
 void DisplayCurrentStatus(SamplingData* samplingData, CurrentSample* currentSample);
 void CloseCurrentAndPrepNewHourWithSample(SamplingData* samplingData, CurrentSample* currentSample, uint16_t* rawVoltage);
 void preSleep();
@@ -143,8 +192,10 @@ void printCharInHexadecimal(char* str, int len);
 void setup() {
 #ifdef USE_EXTERNALVREF
 	analogReference(EXTERNAL);
+	adc_sampler_begin(EXTERNAL);
 #else
 	analogReference(DEFAULT);
+	adc_sampler_begin(DEFAULT);
 #endif
 
 	// Start LCD and Serial
@@ -166,16 +217,33 @@ void setup() {
 	isOutputRelayClosed = openRelay(VBATT_RELAY, true);
 	samplingData.isPowerOutDisabled = true;
 	samplingData.isIntialized = false;
-	samplingData.disableVoltage = DISABLE_VOLTAGE;
-	samplingData.enableVoltage = ENABLE_VOLTAGE;
+	SetVoltageThresholds(&samplingData.voltageScale, DISABLE_MILLIVOLTS, ENABLE_MILLIVOLTS);
+	InitVoltageFilter(&samplingData.voltageFilter, VOLTAGE_FILTER_SHIFT);
+	InitStateOfCharge(&samplingData.stateOfCharge);
 
 	// Clear the current alarm (puts DS3231 INT high)
-	Wire.begin();
+	twi_async_begin();
 	DS3231_init(DS3231_CONTROL_INTCN);
 	DS3231_clear_a1f();
 
-	PrepHourlyData(&samplingData.hourlyData[0], DATA_HOURS);
-	reportControl.previousTime = GetTime();
+	samplingData.hourlyHistory.clear();
+	InitRollups(&samplingData.rollups);
+
+	if (at24c32_log_init(&hourlyLog, 0, AT24C32_SIZE, sizeof(LoggedHour), LOGGED_HOUR_VERSION))
+	{
+		DebugPrint(F("Hours logged in EEPROM: "));
+		DebugPrintln(hourlyLog.count);
+	}
+	else
+	{
+		DebugPrintln(F("No EEPROM log"));
+	}
+	reportControl.previousTime = GetTime().epoch;
+	reportControl.displayFahrenheit = DISPLAY_FAHRENHEIT;
+
+	// Sample every few seconds and be awake right at each hour boundary
+	samplingTimer = addWakeTimer(reportControl.previousTime + WAKE_INTERVAL_SECONDS, WAKE_INTERVAL_SECONDS);
+	hourTimer = addWakeTimer((reportControl.previousTime / 3600 + 1) * 3600, 3600);
 
 	EEPROM.get(0, vDivScale);
 	if (vDivScale != vDivScale)
@@ -186,6 +254,11 @@ void setup() {
 	DebugPrint("vDivScale: ");
 	DebugPrintln(vDivScale);
 
+	// Float math on the voltage only happens here and when the reference is
+	// re-measured: per sample it is integers
+	SetVoltageScale(&samplingData.voltageScale, VREFSCALE(vDivScale));
+	CalibrateReference(&samplingData, reportControl.previousTime);
+
 	CreateArrows(lcd);
 
 	DebugPrintln(F("Setup completed."));
@@ -209,8 +282,8 @@ void loop()
 {
 	static bool firstTime = true;
 	static byte prevADCSRA;
-	char buff[BUFF_MAX];
-
+	static DS3231Snapshot rtcSnapshot;
+	static bool isSnapshotCurrent = false;		// rtcSnapshot was taken by postWakeISRCleanup() on the last wake
 	if (!wakeSleepISRSet)
 	{
 		// Wake/Sleep Interrupts are not set up or were disabled. Set up the button
@@ -227,14 +300,31 @@ void loop()
 	// Has the button on the "go to sleep" pin been toggled?
 	if (sleepRequested)
 	{
-		DoWakingTasks(&samplingData);
+		uint8_t timersFired;
+
+		if (!isSnapshotCurrent)
+		{
+			DS3231_snapshot(&rtcSnapshot);
+		}
+		timersFired = serviceWakeTimers(rtcSnapshot.time.epoch);
+		DebugPrint(F("Timers fired: "));
+		DebugPrintln(timersFired);
+
+		DoWakingTasks(&samplingData, &rtcSnapshot);
 		DebugPrintln(F("sleep REQUESTED"));
 
-		setAlarmAndSleep(RTC_WAKE_ALARM, realTimeClockWakeISR, preSleep, &prevADCSRA, 0, 0, 10);	// 0, 1, 0
-		postWakeISRCleanup(&prevADCSRA);
+		ArmSleepWatch(&samplingData, &currentSample);
+		setWakeAlarmsAndSleep(RTC_WAKE_ALARM, realTimeClockWakeISR, preSleep, &prevADCSRA);
+		postWakeISRCleanup(&prevADCSRA, &rtcSnapshot);
+		isSnapshotCurrent = true;
+		if (sleepWatchTripped())
+		{
+			RecordDip(&samplingData);
+		}
 	}
 	else
 	{
+		isSnapshotCurrent = false;
 		DoReportingTasks(&samplingData, &currentSample, &reportControl, lcd, REPORTING_DELAY_SECONDS);
 	}
 }
@@ -266,8 +356,13 @@ void DisablePower(SamplingData* samplingData, DateTimeDS3231 *now, bool *isRelay
 {
 	DebugPrintln(F("in DisablePower()"));
 
+	if (!samplingData->isPowerOutDisabled && samplingData->currentHourData.disableEvents < 0xFF)
+	{
+		samplingData->currentHourData.disableEvents++;
+	}
 	samplingData->isPowerOutDisabled = true;
-	samplingData->timeDisabled = *now;
+	samplingData->timeDisabled = now->epoch;
+	CancelRecoveryTimer();
 	if (*isRelayClosed)
 	{
 		*isRelayClosed = openRelay(powerRelay);
@@ -280,7 +375,8 @@ void EnablePower(SamplingData* samplingData, DateTimeDS3231 *now, bool* isRelayC
 
 	samplingData->isPowerOutDisabled = false;
 	samplingData->isPowerOutRecovering = false;
-	samplingData->timeEnabled = *now;
+	samplingData->timeEnabled = now->epoch;
+	CancelRecoveryTimer();
 	if (!*isRelayClosed)
 	{
 		*isRelayClosed = closeRelay(powerRelay);
@@ -293,20 +389,99 @@ void SetupRecovery(SamplingData* samplingData, DateTimeDS3231 *now, uint8_t reco
 	DebugPrintln(F("in SetupRecovery()"));
 
 	samplingData->isPowerOutRecovering = true;
-	samplingData->timeRecoveryStarted = *now;
-	samplingData->recoveryTime = *now;
-	addMinutes(&samplingData->recoveryTime, recoveryDurationMinutes);
+	samplingData->timeRecoveryStarted = now->epoch;
+	samplingData->recoveryTime = now->epoch + recoveryDurationMinutes * 60UL;
+	// Wake right when the wait is over instead of on the next sample after it
+	if (recoveryTimer == WAKE_TIMER_NONE)
+	{
+		recoveryTimer = addWakeTimer(samplingData->recoveryTime, 0);
+	}
+	else
+	{
+		setWakeTimer(recoveryTimer, samplingData->recoveryTime, 0);
+	}
 	DebugPrint(F("Will recover in "));
 	DebugPrint(recoveryDurationMinutes);
 	DebugPrintln(F(" minutes"));
 	DebugPrintln(samplingData->isPowerOutRecovering);
 }
 
+void CancelRecoveryTimer()
+{
+	cancelWakeTimer(recoveryTimer);
+	recoveryTimer = WAKE_TIMER_NONE;
+}
+
+
+// The 1.1 V bandgap doesn't move with load or temperature the way the
+// regulator does, but from chip to chip it is anywhere from 1.0 to 1.2 V.
+// Unless BANDGAP_MILLIVOLTS says what it is on this chip, the reference is
+// taken to be REFERENCE_VOLTS now, and later measurements track how far it
+// drifts from that.
+void CalibrateReference(SamplingData* samplingData, uint32_t now)
+{
+	uint32_t	bandgapSum = adc_sampler_bandgap(REFERENCE_SAMPLES);
+
+	referenceMillivolts = REFERENCE_VOLTS * 1000.0 + 0.5;
+	referenceCheckTime = now;
+	if (bandgapSum == 0)
+	{
+		DebugPrintln(F("No bandgap, reference not tracked"));
+		return;
+	}
+
+#ifdef BANDGAP_MILLIVOLTS
+	bandgapConstant = (uint32_t)BANDGAP_MILLIVOLTS * 1024 * REFERENCE_SAMPLES;
+	CheckReference(samplingData, now, true);
+#else
+	bandgapConstant = bandgapSum * referenceMillivolts;
+#endif
+}
+
+
+// Re-measures the ADC reference, no more often than REFERENCE_CHECK_SECONDS
+// unless forced, and rescales the voltage pipeline (thresholds included).
+void CheckReference(SamplingData* samplingData, uint32_t now, bool force)
+{
+	const uint16_t	nominalMillivolts = REFERENCE_VOLTS * 1000.0 + 0.5;
+	uint32_t		bandgapSum;
+	uint32_t		measured;
+
+	if (bandgapConstant == 0 || (!force && now - referenceCheckTime < REFERENCE_CHECK_SECONDS))
+	{
+		return;
+	}
+	referenceCheckTime = now;
+
+	bandgapSum = adc_sampler_bandgap(REFERENCE_SAMPLES);
+	if (bandgapSum == 0)
+	{
+		return;
+	}
+	measured = bandgapConstant / bandgapSum;
+
+	DebugPrint(F("Reference mV: "));
+	DebugPrintln(measured);
+
+	if (measured < (uint32_t)nominalMillivolts * (100 - REFERENCE_TOLERANCE) / 100 ||
+		measured > (uint32_t)nominalMillivolts * (100 + REFERENCE_TOLERANCE) / 100)
+	{
+		DebugPrintln(F("Reference out of range, ignored"));
+		return;
+	}
+
+	if (measured != referenceMillivolts)
+	{
+		referenceMillivolts = measured;
+		SetVoltageScale(&samplingData->voltageScale, referenceMillivolts / 1000.0 / VOLTAGE_FULL_SCALE * vDivScale);
+	}
+}
+
 void RecordTimeDisabled(SamplingData* samplingData, CurrentSample *currentSample)
 {
 	DebugPrintln(F("in RecordTimeDisabled()"));
 
-	if (samplingData->timeDisabled.hour == currentSample->timeNow.hour)
+	if (epochHour(samplingData->timeDisabled) == currentSample->timeNow.hour)
 	{
 		samplingData->currentHourData.downMinutes += (currentSample->minutesDisabled > 60) ? 60 : currentSample->minutesDisabled; // Account for 24 hours+ downtime
 	}
@@ -322,7 +497,7 @@ void RecordTimeDisabled(SamplingData* samplingData, CurrentSample *currentSample
 
 
 
-void DoWakingTasks(SamplingData *samplingData)
+void DoWakingTasks(SamplingData *samplingData, DS3231Snapshot *rtcSnapshot)
 {
 	//DateTimeDS3231	timeNow;
 	char			voltStr[6];
@@ -331,20 +506,40 @@ void DoWakingTasks(SamplingData *samplingData)
 	//float			tempSample;
 	//float			scaledVoltage;
 	uint16_t		rawVoltageSample;
+	uint32_t		tempAge;
 	//uint16_t		minutesDisabled = 0;
 	static bool		tempSource = true;
 
 	DebugPrintln(F("Waking"));
 
-	DS3231_get(&currentSample.timeNow);
-
-	currentSample.tempSample = GetAverageDS3231Temp(3, 5);
-	rawVoltageSample = round(GetAverageRawVoltage(V5_SENSOR, 3, 5));
-	currentSample.scaledVoltage = rawVoltageSample * VREFSCALE(vDivScale);
-
-	if (currentSample.scaledVoltage < DISABLE_VOLTAGE)
+	// The DS3231 only refreshes its temperature every 64 seconds, so the single
+	// reading the snapshot cached is as good as any average of repeated reads.
+	currentSample.timeNow = rtcSnapshot->time;
+	currentSample.tempSample = GetDS3231Temp(false, currentSample.timeNow.epoch, &tempAge);
+	CompensateThresholds(samplingData, &currentSample.tempSample, tempAge, currentSample.timeNow.epoch);
+	CheckReference(samplingData, currentSample.timeNow.epoch, false);
+
+	// Oversampled to 10 + VOLTAGE_EXTRA_BITS bits, so rawVoltageSample is in
+	// 1/VOLTAGE_FULL_SCALE steps of the reference
+	rawVoltageSample = GetOversampledRawVoltage(V5_SENSOR, VOLTAGE_EXTRA_BITS, VOLTAGE_SAMPLE_RATE);
+	currentSample.rawVoltage = rawVoltageSample;
+
+	// Power control acts on the filtered value, so one bad reading or a short
+	// surge can't open the relay.  The hourly figures keep the raw readings.
+	currentSample.filteredVoltage = FilterVoltage(&samplingData->voltageFilter, rawVoltageSample);
+	currentSample.millivolts = RawToMillivolts(&samplingData->voltageScale, currentSample.filteredVoltage);
+
+	// Updated before power control acts, so a relay change this wake counts
+	// from the next sample
+	UpdateStateOfCharge(&samplingData->stateOfCharge, currentSample.millivolts, currentSample.tempSample,
+		isOutputRelayClosed, samplingData->voltageScale.disableMillivolts, currentSample.timeNow.epoch);
+	currentSample.socPercent = samplingData->stateOfCharge.percent;
+	currentSample.socResting = samplingData->stateOfCharge.isResting;
+	currentSample.minutesToCutoff = samplingData->stateOfCharge.minutesToCutoff;
+
+	if (currentSample.filteredVoltage < samplingData->voltageScale.disableRaw)
 	{
-		DebugPrintln(F("scaledVoltage < DISABLE_VOLTAGE"));
+		DebugPrintln(F("filteredVoltage < disableRaw"));
 
 		if (!samplingData->isIntialized)
 		{
@@ -364,6 +559,7 @@ void DoWakingTasks(SamplingData *samplingData)
 			if (samplingData->isPowerOutRecovering)
 			{
 				samplingData->isPowerOutRecovering = false;
+				CancelRecoveryTimer();
 				lcdClearLine(lcd, 2);
 			}
 		}
@@ -371,12 +567,12 @@ void DoWakingTasks(SamplingData *samplingData)
 
 	if (samplingData->isPowerOutDisabled)
 	{
-		currentSample.minutesDisabled = dateDiffMinutes(&currentSample.timeNow, &samplingData->timeDisabled);
+		currentSample.minutesDisabled = (currentSample.timeNow.epoch - samplingData->timeDisabled) / 60;
 	}
 
-	if (currentSample.scaledVoltage >= ENABLE_VOLTAGE)
+	if (currentSample.filteredVoltage >= samplingData->voltageScale.enableRaw)
 	{
-		DebugPrintln(F("scaledVoltage >= ENABLE_VOLTAGE"));
+		DebugPrintln(F("filteredVoltage >= enableRaw"));
 
 		if (!samplingData->isIntialized)
 		{
@@ -395,7 +591,7 @@ void DoWakingTasks(SamplingData *samplingData)
 				}
 				else
 				{
-					int32_t secondsSpentRecovering = dateDiffSeconds(&currentSample.timeNow, &samplingData->timeRecoveryStarted);
+					int32_t secondsSpentRecovering = currentSample.timeNow.epoch - samplingData->timeRecoveryStarted;
 
 					DebugPrint(F("Seconds Spent Recovering: "));
 					DebugPrintln(secondsSpentRecovering);
@@ -422,29 +618,175 @@ void DoWakingTasks(SamplingData *samplingData)
 		AddSampleToCurrentHour(&samplingData->currentHourData, &currentSample.timeNow, &rawVoltageSample, &currentSample.tempSample);
 	}
 
+	// Sample again sooner or later depending on where the voltage is heading
+	samplingData->wakeInterval = ChooseWakeInterval(samplingData, &currentSample);
+	samplingData->previousMillivolts = currentSample.millivolts;
+	samplingData->previousSampleTime = currentSample.timeNow.epoch;
+	setWakeTimer(samplingTimer, currentSample.timeNow.epoch + samplingData->wakeInterval, samplingData->wakeInterval);
+	DebugPrint(F("Next sample in "));
+	DebugPrintln(samplingData->wakeInterval);
+
 	DisplayCurrentStatus(samplingData, &currentSample);
 
 }
 
 
+// Seconds to the next sample.  What matters is the threshold that would change
+// something next: the disable threshold while power is on or recovering, the
+// enable threshold while it is off.  Far from it and steady, sleep for
+// WAKE_INTERVAL_MAX; near it, no longer than WAKE_INTERVAL_SECONDS; heading
+// for it, often enough to get WAKE_SAFETY_FACTOR samples in before the
+// current slope would get there.  The distance goes by whichever of this
+// wake's raw reading and the filtered value is nearer the threshold: the
+// median rightly ignores the first readings of a real sag, but they must not
+// buy a WAKE_INTERVAL_MAX sleep before the filter catches up.
+uint16_t ChooseWakeInterval(SamplingData* samplingData, CurrentSample* currentSample)
+{
+	VoltageScale*	scale = &samplingData->voltageScale;
+	uint16_t		rawMillivolts = RawToMillivolts(scale, currentSample->rawVoltage);
+	uint32_t		elapsed = currentSample->timeNow.epoch - samplingData->previousSampleTime;
+	uint32_t		interval = WAKE_INTERVAL_MAX;
+	int32_t			distance;						// mV left to the threshold
+	int32_t			approach;						// mV closer to it than at the previous sample
+
+	if (!samplingData->isIntialized || samplingData->previousSampleTime == 0)
+	{
+		return WAKE_INTERVAL_SECONDS;
+	}
+
+	// After a dip, sample quickly until the filter has either seen it off or
+	// been convinced by it
+	if (samplingData->dipFollowUps > 0)
+	{
+		samplingData->dipFollowUps--;
+		return WAKE_INTERVAL_MIN;
+	}
+
+	if (samplingData->isPowerOutDisabled && !samplingData->isPowerOutRecovering)
+	{
+		distance = (int32_t)scale->enableMillivolts - max(rawMillivolts, currentSample->millivolts);
+		approach = (int32_t)currentSample->millivolts - samplingData->previousMillivolts;
+	}
+	else
+	{
+		distance = (int32_t)min(rawMillivolts, currentSample->millivolts) - scale->disableMillivolts;
+		approach = (int32_t)samplingData->previousMillivolts - currentSample->millivolts;
+	}
+
+	if (distance <= 0)
+	{
+		return WAKE_INTERVAL_MIN;
+	}
+	if (distance <= WAKE_NEAR_MILLIVOLTS)
+	{
+		interval = WAKE_INTERVAL_SECONDS;
+	}
+	if (approach > 0 && elapsed > 0)
+	{
+		interval = min(interval, (uint32_t)distance * elapsed / approach / WAKE_SAFETY_FACTOR);
+	}
+
+	return constrain(interval, (uint32_t)WAKE_INTERVAL_MIN, (uint32_t)WAKE_INTERVAL_MAX);
+}
+
+
+// Moves the thresholds with the battery temperature.  Nothing happens until
+// the temperature leaves its bucket, so most wakes cost one compare.  The
+// DS3231 converts only every DS3231_TEMP_PERIOD seconds, so before the
+// thresholds move, or when the cached reading is older than that, a
+// conversion is forced and *quarterDegrees is replaced by its result.
+void CompensateThresholds(SamplingData* samplingData, int16_t* quarterDegrees, uint32_t age, uint32_t now)
+{
+#ifdef USE_TEMP_COMPENSATION
+	uint8_t		bucket = TemperatureBucket(*quarterDegrees, samplingData->temperatureBucket);
+	int16_t		offset;
+
+	if (bucket == samplingData->temperatureBucket && age <= DS3231_TEMP_PERIOD)
+	{
+		return;
+	}
+	*quarterDegrees = GetDS3231Temp(true, now, NULL);
+	bucket = TemperatureBucket(*quarterDegrees, samplingData->temperatureBucket);
+	if (bucket == samplingData->temperatureBucket)
+	{
+		return;
+	}
+	samplingData->temperatureBucket = bucket;
+	offset = ThresholdOffset(bucket);
+	SetVoltageThresholds(&samplingData->voltageScale, DISABLE_MILLIVOLTS + offset, ENABLE_MILLIVOLTS + offset);
+
+	DebugPrint(F("Threshold offset mV: "));
+	DebugPrintln(offset);
+#endif
+}
+
+
+// While power is on (or recovering) and the voltage is above the disable
+// threshold, have the watchdog look at the battery during sleep, so a sag is
+// caught within SLEEP_WATCH_PERIOD rather than at the next sample.  The glance
+// is a single 10 bit conversion, so the threshold drops the extra bits.
+// After a dip the watch stays off through the follow-up samples, which are
+// already looking, and until the filtered voltage has recovered
+// DIP_REARM_MILLIVOLTS above the threshold, so a sag that hovers around it
+// counts once and doesn't keep resetting the follow-ups.
+void ArmSleepWatch(SamplingData* samplingData, CurrentSample* currentSample)
+{
+	uint16_t	threshold = (samplingData->voltageScale.disableRaw + (1 << VOLTAGE_EXTRA_BITS) - 1) >> VOLTAGE_EXTRA_BITS;
+
+	if (samplingData->isInDip &&
+		currentSample->millivolts >= samplingData->voltageScale.disableMillivolts + DIP_REARM_MILLIVOLTS)
+	{
+		samplingData->isInDip = false;
+	}
+
+	if (!samplingData->isInDip && samplingData->dipFollowUps == 0 &&
+		(!samplingData->isPowerOutDisabled || samplingData->isPowerOutRecovering) &&
+		currentSample->filteredVoltage >= samplingData->voltageScale.disableRaw)
+	{
+		setSleepWatch(V5_SENSOR, threshold, SLEEP_WATCH_PERIOD);
+	}
+	else
+	{
+		clearSleepWatch();
+	}
+}
+
+
+// The dip itself doesn't open the relay: that is still up to the filtered
+// samples.  One is taken straight away, and the next few come quickly (see
+// ChooseWakeInterval()).  It is counted in the hour it happened in.
+void RecordDip(SamplingData* samplingData)
+{
+	if (samplingData->currentHourData.dipEvents < 0xFF)
+	{
+		samplingData->currentHourData.dipEvents++;
+	}
+	samplingData->isInDip = true;
+	samplingData->dipFollowUps = VOLTAGE_FILTER_TAPS;
+
+	DebugPrint(F("Dip while asleep, #"));
+	DebugPrintln(samplingData->currentHourData.dipEvents);
+}
+
+
 void DisplayCurrentStatus(SamplingData *samplingData, CurrentSample *currentSample)
 {
 	char			buffer[20];
 	char			voltStr[6];
 	char			tempStr[6];
 
-	formatFloat(currentSample->scaledVoltage, voltStr, 5, 2);
-	formatFloat(currentSample->tempSample, tempStr, 5, 1);
+	formatMillivolts(currentSample->millivolts, voltStr, 5, 2);
+	formatQuarterDegrees(currentSample->tempSample, tempStr, 5, DISPLAY_FAHRENHEIT);
 
 	//sprintf(buffer, "V: %s T%d: %s", voltStr, tempSource + 1, tempStr);
-	sprintf(buffer, "%sv %s%c %02d:%02d", voltStr, tempStr, 0xDF, currentSample->timeNow.hour, currentSample->timeNow.min);
+	sprintf_P(buffer, PSTR("%sv %s%c %02d:%02d"), voltStr, tempStr, 0xDF, currentSample->timeNow.hour, currentSample->timeNow.min);
 	lcd.setCursor(0, 0);
 	lcdPrint(lcd, buffer, 20);
 
 	lcd.setCursor(0, 1);
 	if (samplingData->isPowerOutDisabled)
 	{
-		sprintf(buffer, "Power off %d mins", currentSample->minutesDisabled);
+		sprintf_P(buffer, PSTR("Power off %d mins"), currentSample->minutesDisabled);
 	}
 	else
 	{
@@ -455,9 +797,9 @@ void DisplayCurrentStatus(SamplingData *samplingData, CurrentSample *currentSamp
 
 	if (samplingData->isPowerOutRecovering)
 	{
-		ElapsedTime timeToRecover = dateDiff(&currentSample->timeNow, &samplingData->recoveryTime);
+		ElapsedTime timeToRecover = secondsToElapsed(currentSample->timeNow.epoch - samplingData->recoveryTime);
 		lcd.setCursor(0, 2);
-		sprintf(buffer, "Recovery in %2d:%02d", abs(timeToRecover.minute), abs(timeToRecover.second));
+		sprintf_P(buffer, PSTR("Recovery in %2d:%02d"), abs(timeToRecover.minute), abs(timeToRecover.second));
 		lcdPrint(lcd, buffer, 20);
 	}
 }
@@ -476,8 +818,19 @@ void CloseCurrentAndPrepNewHourWithSample(SamplingData *samplingData, CurrentSam
 		{
 			samplingData->currentHourData.downMinutes += (currentSample->minutesDisabled > 60) ? 60 : currentSample->minutesDisabled;
 		}
-		CloseCurrentHour(samplingData->hourlyData, &samplingData->currentHourData, samplingData->currentHour % DATA_HOURS);
+		// previousSampleTime is still the closed hour's last sample
+		HourlyData* closedHour = samplingData->hourlyHistory.close(&samplingData->currentHourData, samplingData->previousSampleTime / 3600);
+
+		StateOfChargeHourClosed(&samplingData->stateOfCharge, RawToMillivolts(&samplingData->voltageScale, HourlyVAvg(closedHour)));
+		RollUpHour(&samplingData->rollups, closedHour, samplingData->previousSampleTime, currentSample->timeNow.epoch);
+
+		LoggedHour loggedHour;
+		loggedHour.timeClosed = currentSample->timeNow.epoch;
+		loggedHour.hourlyData = *closedHour;
+		at24c32_log_append(&hourlyLog, &loggedHour);
 	}
+	SetHistogramRange(&samplingData->currentHourData.vHistogram,
+		MillivoltsToRaw(&samplingData->voltageScale, HISTOGRAM_LOW_MILLIVOLTS), MillivoltsToRaw(&samplingData->voltageScale, HISTOGRAM_HIGH_MILLIVOLTS));
 	PrepCurrentHour(&samplingData->currentHourData, &currentSample->timeNow, rawVoltage, &currentSample->tempSample);
 	samplingData->currentHour = currentSample->timeNow.hour;
 }
@@ -23,7 +23,12 @@
 
 #include "DS3231Helpers.h"
 #include "ds3231.h"
+#include "adc_sampler.h"
 #include <avr/sleep.h>
+#ifdef CONFIG_SLEEP_WATCH
+ #include <avr/interrupt.h>
+ #include <avr/wdt.h>
+#endif
 
 
 // Set the next alarm
@@ -74,13 +79,243 @@ void setNextAlarm(uint8_t wakeInHours, uint8_t wakeInMinutes, uint8_t wakeInSeco
 
 
 
+/*==========================+
+|	Wake timers				|
++==========================*/
+
+static WakeTimer	wakeTimers[WAKE_TIMERS_MAX];
+static uint32_t		wakeTimersNow;		// RTC time handed to the last serviceWakeTimers()
+static uint32_t		wakeTimersMillis;	// millis() at that moment
+
+
+// Claim a free timer slot.  Returns WAKE_TIMER_NONE if the table is full.
+uint8_t addWakeTimer(uint32_t deadline, uint32_t period)
+{
+	for (uint8_t i = 0; i < WAKE_TIMERS_MAX; i++)
+	{
+		if (wakeTimers[i].deadline == 0)
+		{
+			setWakeTimer(i, deadline, period);
+			return i;
+		}
+	}
+	return WAKE_TIMER_NONE;
+}
+
+
+void setWakeTimer(uint8_t timer, uint32_t deadline, uint32_t period)
+{
+	if (timer < WAKE_TIMERS_MAX)
+	{
+		wakeTimers[timer].deadline = deadline;
+		wakeTimers[timer].period = period;
+	}
+}
+
+
+void cancelWakeTimer(uint8_t timer)
+{
+	setWakeTimer(timer, 0, 0);
+}
+
+
+// Returns a bitmask (bit n for timer n) of the timers that are due at 'now'.
+// Periodic timers move on to their next deadline in the future; one-shots are
+// freed.
+uint8_t serviceWakeTimers(uint32_t now)
+{
+	uint8_t fired = 0;
+
+	wakeTimersNow = now;
+	wakeTimersMillis = millis();
+
+	for (uint8_t i = 0; i < WAKE_TIMERS_MAX; i++)
+	{
+		WakeTimer *timer = &wakeTimers[i];
+
+		if (timer->deadline == 0 || timer->deadline > now)
+			continue;
+
+		fired |= 1 << i;
+		if (timer->period == 0)
+		{
+			timer->deadline = 0;
+		}
+		else
+		{
+			// Skip any periods slept through rather than firing them back to back
+			timer->deadline += ((now - timer->deadline) / timer->period + 1) * timer->period;
+		}
+	}
+	return fired;
+}
+
+
+// Load the nearest whole-minute deadline into A2 and the nearest other one
+// into A1, both matched on date, hour, minute (and second), and enable the
+// interrupt of each alarm that got a deadline.
+void programWakeAlarms(void)
+{
+	DateTimeDS3231	alarm;
+	uint32_t		earliest;
+	uint32_t		nextA1 = 0;
+	uint32_t		nextA2 = 0;
+	uint8_t			control = DS3231_CONTROL_INTCN;
+	uint8_t			flags[5] = { 0, 0, 0, 0, 0 };		// A1M1-A1M4 / A2M2-A2M4 all 0: match date, hour, minute, second
+
+	// Time has moved on since the RTC was last read; estimate it rather than
+	// reading the clock again.  A deadline has to be at least 2 seconds out
+	// to be certain the RTC hasn't passed it before the alarm is loaded.
+	earliest = wakeTimersNow + (millis() - wakeTimersMillis) / 1000 + 2;
+
+	for (uint8_t i = 0; i < WAKE_TIMERS_MAX; i++)
+	{
+		uint32_t deadline = wakeTimers[i].deadline;
+
+		if (deadline == 0)
+			continue;
+
+		if (deadline % 60 == 0 && deadline >= earliest)
+		{
+			if (nextA2 == 0 || deadline < nextA2)
+				nextA2 = deadline;
+		}
+		else
+		{
+			if (deadline < earliest)
+				deadline = earliest;
+			if (nextA1 == 0 || deadline < nextA1)
+				nextA1 = deadline;
+		}
+	}
+
+	if (nextA1 != 0)
+	{
+		DS3231_epoch_to_time(nextA1, &alarm);
+		DS3231_set_a1(alarm.sec, alarm.min, alarm.hour, alarm.mday, flags);
+		control |= DS3231_CONTROL_A1IE;
+	}
+	if (nextA2 != 0)
+	{
+		DS3231_epoch_to_time(nextA2, &alarm);
+		DS3231_set_a2(alarm.min, alarm.hour, alarm.mday, flags);
+		control |= DS3231_CONTROL_A2IE;
+	}
+
+	DS3231_set_creg(control);
+}
+
+
+void setWakeAlarmsAndSleep(uint8_t wakePin, void (*wakeISR)(), void (*preSleepAction)(), byte *prevADCSRA) {
+  programWakeAlarms();
+  sleepUntilAlarm(wakePin, wakeISR, preSleepAction, prevADCSRA);
+}
+
+
+
 void setAlarmAndSleep(uint8_t wakePin, void (*wakeISR)(), void (*preSleepAction)(), byte *prevADCSRA, uint8_t wakeInHours, uint8_t wakeInMinutes, uint8_t wakeInSeconds) {
   // Set the DS3231 alarm to wake up in some number of hours, minutes, seconds
   setNextAlarm(wakeInHours, wakeInMinutes, wakeInSeconds);
+  sleepUntilAlarm(wakePin, wakeISR, preSleepAction, prevADCSRA);
+}
+
+
+
+/*==========================+
+|	Sleep watch				|
++==========================*/
+
+static uint8_t			sleepWatchPin;
+static uint16_t			sleepWatchThreshold;
+static uint8_t			sleepWatchPeriod;
+static bool				sleepWatchArmed = false;
+static bool				sleepWatchHit = false;
+static volatile bool	sleepWatchDue = false;		// set by the watchdog interrupt
 
+
+void setSleepWatch(uint8_t pin, uint16_t threshold, uint8_t period)
+{
+	sleepWatchPin = pin;
+	sleepWatchThreshold = threshold;
+	sleepWatchPeriod = period;
+	sleepWatchArmed = true;
+}
+
+
+void clearSleepWatch(void)
+{
+	sleepWatchArmed = false;
+}
+
+
+bool sleepWatchTripped(void)
+{
+	return sleepWatchHit;
+}
+
+
+#ifdef CONFIG_SLEEP_WATCH
+
+ISR(WDT_vect)
+{
+	sleepWatchDue = true;
+}
+
+
+// Interrupt-only watchdog, no reset.  Both need interrupts off: the change
+// enable sequence has to be done within four cycles.
+static void sleepWatchStart(void)
+{
+	wdt_reset();
+	MCUSR &= ~_BV(WDRF);
+	WDTCSR = _BV(WDCE) | _BV(WDE);
+	WDTCSR = _BV(WDIE) | (sleepWatchPeriod & 0x07) | ((sleepWatchPeriod & 0x08) ? _BV(WDP3) : 0);
+}
+
+
+static void sleepWatchStop(void)
+{
+	WDTCSR = _BV(WDCE) | _BV(WDE);
+	WDTCSR = 0;
+}
+
+
+// Called after sleep_cpu() returns.  Woken by the watchdog alone: take a
+// reading, and go back to sleep unless it is low.  Any other wake ends it: the
+// RTC wake ISR clears SE, and nothing else sets sleepWatchDue.
+static void sleepWatchLoop(uint8_t wakePin)
+{
+	while (sleepWatchDue && (SMCR & _BV(SE)))
+	{
+		sleepWatchDue = false;
+		if (adc_sampler_single(sleepWatchPin) < sleepWatchThreshold)
+		{
+			// Awake for good: leave things as the RTC wake ISR would have
+			sleepWatchHit = true;
+			sleep_disable();
+			detachInterrupt(digitalPinToInterrupt(wakePin));
+			break;
+		}
+
+		noInterrupts();
+		MCUCR = bit(BODS) | bit(BODSE);
+		MCUCR = bit(BODS);
+		interrupts();
+		sleep_cpu();
+	}
+
+	noInterrupts();
+	sleepWatchStop();
+	interrupts();
+}
+
+#endif
+
+
+void sleepUntilAlarm(uint8_t wakePin, void (*wakeISR)(), void (*preSleepAction)(), byte *prevADCSRA) {
   // Disable the ADC (Analog to digital converter, pins A0 [14] to A5 [19])
-  *prevADCSRA = ADCSRA;
-  ADCSRA = 0;
+  *prevADCSRA = adc_sampler_suspend();
+  sleepWatchHit = false;
 
   /* Set the type of sleep mode we want. Can be one of (in order of power saving):
 
@@ -113,6 +348,13 @@ void setAlarmAndSleep(uint8_t wakePin, void (*wakeISR)(), void (*preSleepAction)
   noInterrupts();
   attachInterrupt(digitalPinToInterrupt(wakePin), wakeISR, LOW);
 
+#ifdef CONFIG_SLEEP_WATCH
+  if (sleepWatchArmed) {
+    sleepWatchDue = false;
+    sleepWatchStart();
+  }
+#endif
+
   if (preSleepAction != NULL) {
     (*preSleepAction)();
   }
@@ -122,16 +364,33 @@ void setAlarmAndSleep(uint8_t wakePin, void (*wakeISR)(), void (*preSleepAction)
 
   // And enter sleep mode as set above
   sleep_cpu();
+
+#ifdef CONFIG_SLEEP_WATCH
+  if (sleepWatchArmed) {
+    sleepWatchLoop(wakePin);
+  }
+#endif
 }
 
 
 
 
-void postWakeISRCleanup(byte *prevADCSRA) {
-  // Clear existing alarm so int pin goes high again
-  DS3231_clear_a1f();
+void postWakeISRCleanup(byte *prevADCSRA, DS3231Snapshot *snapshot) {
+  // Grab every RTC register in one burst; the wake tasks work from this copy.
+  // The transfer runs in the background while we bring the ADC back up.
+  uint8_t snapshotStarted = DS3231_snapshot_start();
 
   // Re-enable ADC if it was previously running
-  ADCSRA = *prevADCSRA;
+  adc_sampler_resume(*prevADCSRA);
+
+  if (!snapshotStarted || !DS3231_snapshot_finish(snapshot))
+  {
+    DS3231_snapshot(snapshot);
+  }
+
+  // Clear existing alarms so int pin goes high again.  The snapshot refreshed
+  // the driver's register cache, so this is a single write with no read.
+  // The flags stay in snapshot->status to show which alarm woke us.
+  DS3231_clear_alarm_flags();
 }
 
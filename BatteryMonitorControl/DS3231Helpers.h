@@ -27,13 +27,59 @@
 #include "Arduino.h"
 #include "config.h"
 #include "ds3231.h"
-#include <Wire.h>
+#include "twi_async.h"
 
 
+/*
+  Wake timers.
+
+  A small table of deadlines (epoch seconds, see DS3231_epoch()) shared by
+  everything that needs the MCU awake at a given time.  Before sleeping, the
+  nearest deadline that falls on a whole minute goes into Alarm 2 and the
+  nearest one that doesn't goes into Alarm 1, so e.g. the hourly rollover can
+  sit in A2 untouched while A1 follows the sampling interval.  On wake,
+  serviceWakeTimers() says which timers are due and re-arms the periodic ones.
+*/
+#define WAKE_TIMERS_MAX		4
+#define WAKE_TIMER_NONE		0xFF
+
+struct wakeTimerStruct {
+	uint32_t	deadline;		// epoch seconds when next due, 0 when the slot is free
+	uint32_t	period;			// seconds between firings, 0 for a one-shot
+};
+typedef struct wakeTimerStruct WakeTimer;
+
+uint8_t addWakeTimer(uint32_t deadline, uint32_t period);
+void setWakeTimer(uint8_t timer, uint32_t deadline, uint32_t period);
+void cancelWakeTimer(uint8_t timer);
+uint8_t serviceWakeTimers(uint32_t now);
+void programWakeAlarms(void);
+void sleepUntilAlarm(uint8_t wakePin, void (*wakeISR)(), void (*preSleepAction)(), byte *prevADCSRA);
+void setWakeAlarmsAndSleep(uint8_t wakePin, void (*wakeISR)(), void (*preSleepAction)(), byte *prevADCSRA);
+
+/*
+  Sleep watch.
+
+  setSleepWatch() keeps an eye on one analog pin through power-down sleep.  The
+  watchdog wakes the CPU every 'period' (16 ms << period, so SLEEP_WATCH_1S is
+  about a second) for a single conversion, a fraction of a millisecond awake,
+  and sleepUntilAlarm() only returns before the RTC alarm if the reading is
+  below 'threshold'.  sleepWatchTripped() then says so until the next sleep.
+  Without CONFIG_SLEEP_WATCH the sleep simply lasts until the alarm.
+*/
+#define SLEEP_WATCH_1S		6
+#define SLEEP_WATCH_2S		7
+#define SLEEP_WATCH_4S		8
+#define SLEEP_WATCH_8S		9
+
+void setSleepWatch(uint8_t pin, uint16_t threshold, uint8_t period);
+void clearSleepWatch(void);
+bool sleepWatchTripped(void);
+
 void setAlarmAndSleep(uint8_t wakePin, void (*wakeISR)(), void (*preSleepAction)(), byte *prevADCSRA, uint8_t wakeInHours, uint8_t wakeInMinutes, uint8_t wakeInSeconds);
 
 void setNextAlarm(uint8_t wakeInHours, uint8_t wakeInMinutes, uint8_t wakeInSeconds);
 
-void postWakeISRCleanup(byte *prevADCSRA);
+void postWakeISRCleanup(byte *prevADCSRA, DS3231Snapshot *snapshot);
 
 #endif
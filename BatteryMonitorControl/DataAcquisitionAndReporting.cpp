@@ -9,6 +9,13 @@
 #include "DataAcquisitionAndReporting.h"
 #include "DateTimeHelpers.h"
 #include "HourlyDataTypes.h"
+#include "adc_sampler.h"
+
+
+static void ReportExtremes(SamplingData* samplingData, ReportControl* reportControl, LiquidCrystal lcd);
+static void ReportPercentiles(SamplingData* samplingData, LiquidCrystal lcd);
+static void ReportRollups(SamplingData* samplingData, LiquidCrystal lcd);
+static uint16_t FreeMemory();
 
 
 void DoReportingTasks(SamplingData* samplingData, CurrentSample* currentSample, ReportControl* reportControl, LiquidCrystal lcd, int8_t reportingDelaySeconds)
@@ -21,11 +28,11 @@ void DoReportingTasks(SamplingData* samplingData, CurrentSample* currentSample,
 	char			tempStr2[6];
 
 	DS3231_get(&timeNow);
-	int32_t secondsElapsed = dateDiffSeconds(&timeNow, &(reportControl->previousTime));
+	int32_t secondsElapsed = timeNow.epoch - reportControl->previousTime;
 
 	if (secondsElapsed >= reportingDelaySeconds)
 	{
-		reportControl->previousTime = timeNow;
+		reportControl->previousTime = timeNow.epoch;
 		lcd.clear();
 		switch (reportControl->reportingCycle)
 		{
@@ -33,35 +40,56 @@ void DoReportingTasks(SamplingData* samplingData, CurrentSample* currentSample,
 			lcd.setCursor(0, 0);
 			if (samplingData->isPowerOutDisabled)
 			{
-				lcdPrint(lcd, "Power Off", 20);
+				lcdPrint(lcd, F("Power Off"), 20);
 			}
 			else {
-				lcdPrint(lcd, "Power On", 20);
+				lcdPrint(lcd, F("Power On"), 20);
 			}
 
 
 			lcd.setCursor(0, 1);
-			formatFloat(samplingData->disableVoltage, voltStr1, 5, 2);
-			sprintf(buffer, "Disable at %sv", voltStr1);
+			formatMillivolts(samplingData->voltageScale.disableMillivolts, voltStr1, 5, 2);
+			sprintf_P(buffer, PSTR("Disable at %sv"), voltStr1);
 			lcdPrint(lcd, buffer, 20);
 
 			lcd.setCursor(0, 2);
-			formatFloat(samplingData->enableVoltage, voltStr2, 5, 2);
-			sprintf(buffer, "Enable at  %sv", voltStr2);
+			formatMillivolts(samplingData->voltageScale.enableMillivolts, voltStr2, 5, 2);
+			sprintf_P(buffer, PSTR("Enable at  %sv"), voltStr2);
+			lcdPrint(lcd, buffer, 20);
+
+			lcd.setCursor(0, 3);
+			sprintf_P(buffer, PSTR("Free RAM %u bytes"), FreeMemory());
 			lcdPrint(lcd, buffer, 20);
 			break;
 		case Report1:
+			lcd.setCursor(0, 0);
+			if (currentSample->socPercent == SOC_UNKNOWN)
+			{
+				lcdPrint(lcd, F("Charge unknown"), 20);
+			}
+			else {
+				sprintf_P(buffer, currentSample->socResting ? PSTR("Charge %u%% (rest)") : PSTR("Charge %u%%"), currentSample->socPercent);
+				lcdPrint(lcd, buffer, 20);
+			}
 
 			lcd.setCursor(0, 1);
-			lcdPrint(lcd, "reportingCycle 1", 20);
+			if (currentSample->minutesToCutoff == SOC_NO_CUTOFF)
+			{
+				lcdPrint(lcd, F("Cutoff: not falling"), 20);
+			}
+			else {
+				sprintf_P(buffer, PSTR("Cutoff in %uh %02um"), currentSample->minutesToCutoff / 60, currentSample->minutesToCutoff % 60);
+				lcdPrint(lcd, buffer, 20);
+			}
 			break;
 		case Report2:
-			lcd.setCursor(0, 1);
-			lcdPrint(lcd, "reportingCycle 2", 20);
+			ReportExtremes(samplingData, reportControl, lcd);
 			break;
 		case Report3:
-			lcd.setCursor(0, 1);
-			lcdPrint(lcd, "reportingCycle 3", 20);
+			ReportPercentiles(samplingData, lcd);
+			break;
+		case Report4:
+			ReportRollups(samplingData, lcd);
 			break;
 		default:
 			break;
@@ -76,39 +104,177 @@ void DoReportingTasks(SamplingData* samplingData, CurrentSample* currentSample,
 
 
 
-float GetAverageTemp(uint8_t tempPin, float tempScale, uint8_t samples, uint16_t delayMillis) {
-	int32_t rawTempSum = 0;
-	uint8_t i;
-	for (i = 0; i < samples; i++) {
-		delay(delayMillis);
-		rawTempSum += analogRead(tempPin);
+// The lowest and highest voltage and temperature of the hours kept, and
+// when they happened
+static void ReportExtremes(SamplingData* samplingData, ReportControl* reportControl, LiquidCrystal lcd)
+{
+	RecentHours*	history = &samplingData->hourlyHistory;
+	HourlyData*		minVoltage = history->find(MinVoltage);
+	HourlyData*		maxVoltage = history->find(MaxVoltage);
+	HourlyData*		minTemp = history->find(MinTemp);
+	HourlyData*		maxTemp = history->find(MaxTemp);
+	uint16_t		downMinutes;
+	char			buffer[20];
+	char			valueStr[6];
+	char			valueStr2[6];
+
+	lcd.setCursor(0, 0);
+	if (minVoltage == NULL)
+	{
+		lcdPrint(lcd, F("No hours closed yet"), 20);
+		return;
 	}
-	return rawTempSum / static_cast<float>(samples) * tempScale * 100.0 / 1024.0;
+	downMinutes = history->fold((uint16_t)0, [](uint16_t total, const HourlyData* hourData) -> uint16_t {
+		return total + hourData->downMinutes;
+	});
+	sprintf_P(buffer, PSTR("%uh: %um down"), RecentHours::Size, downMinutes);
+	lcdPrint(lcd, buffer, 20);
+
+	lcd.setCursor(0, 1);
+	formatMillivolts(RawToMillivolts(&samplingData->voltageScale, HourlyVMin(minVoltage)), valueStr, 5, 2);
+	sprintf_P(buffer, PSTR("Lo %sv at %02d:%02d"), valueStr, minVoltage->hour, minVoltage->minMinute);
+	lcdPrint(lcd, buffer, 20);
+
+	lcd.setCursor(0, 2);
+	formatMillivolts(RawToMillivolts(&samplingData->voltageScale, HourlyVMax(maxVoltage)), valueStr, 5, 2);
+	sprintf_P(buffer, PSTR("Hi %sv at %02d:%02d"), valueStr, maxVoltage->hour, maxVoltage->maxMinute);
+	lcdPrint(lcd, buffer, 20);
+
+	lcd.setCursor(0, 3);
+	formatQuarterDegrees(HourlyTMin(minTemp), valueStr, 5, reportControl->displayFahrenheit);
+	formatQuarterDegrees(HourlyTMax(maxTemp), valueStr2, 5, reportControl->displayFahrenheit);
+	sprintf_P(buffer, PSTR("T %s to %s%c"), valueStr, valueStr2, 0xDF);
+	lcdPrint(lcd, buffer, 20);
 }
 
 
-float GetAverageDS3231Temp(uint8_t samples, uint16_t delayMillis) {
-	float rawTempSum = 0;
+// How the voltage has been spread over the hour so far: whether it sat near
+// a threshold or only touched it
+static void ReportPercentiles(SamplingData* samplingData, LiquidCrystal lcd)
+{
+	static const uint8_t	percents[] = { 10, 50, 90 };
+	char					buffer[20];
+	char					voltStr[6];
+
+	lcd.setCursor(0, 0);
+	sprintf_P(buffer, PSTR("Hour so far, %u"), samplingData->currentHourData.samples);
+	lcdPrint(lcd, buffer, 20);
 
-	for (uint8_t i = 0; i < samples; i++) {
-		delay(delayMillis);
-		rawTempSum += DS3231_get_treg();
+	for (uint8_t i = 0; i < 3; i++)
+	{
+		lcd.setCursor(0, i + 1);
+		formatMillivolts(RawToMillivolts(&samplingData->voltageScale, CurrentHourPercentile(&samplingData->currentHourData, percents[i])), voltStr, 5, 2);
+		sprintf_P(buffer, PSTR("%2u%% below %sv"), percents[i], voltStr);
+		lcdPrint(lcd, buffer, 20);
 	}
-	return rawTempSum / static_cast<float>(samples) * 1.8 + 32.0;
 }
 
 
-float GetAverageRawVoltage(uint8_t voltagePin, uint8_t samples, uint16_t delayMillis) {
-	int32_t rawVoltageSum = 0;
-	uint8_t i;
-	for (i = 0; i < samples; i++) {
-		delay(delayMillis);
-		rawVoltageSum += analogRead(voltagePin);
+// One rollup as two lines: its date, how long the power was off, and the
+// voltage range
+static void ReportRollup(SamplingData* samplingData, LiquidCrystal lcd, uint8_t row, const char* label, RollupData* rollup, uint16_t day)
+{
+	DateTimeDS3231	date;
+	char			buffer[20];
+	char			voltStr1[6];
+	char			voltStr2[6];
+
+	DS3231_epoch_to_time((uint32_t)day * SECONDS_PER_DAY, &date);
+	lcd.setCursor(0, row);
+	sprintf_P(buffer, PSTR("%s %02u/%02u %um off"), label, date.mon, date.mday, rollup->downMinutes);
+	lcdPrint(lcd, buffer, 20);
+
+	lcd.setCursor(0, row + 1);
+	formatMillivolts(RawToMillivolts(&samplingData->voltageScale, rollup->vMin), voltStr1, 5, 2);
+	formatMillivolts(RawToMillivolts(&samplingData->voltageScale, rollup->vMax), voltStr2, 5, 2);
+	sprintf_P(buffer, PSTR("Lo %sv Hi %sv"), voltStr1, voltStr2);
+	lcdPrint(lcd, buffer, 20);
+}
+
+
+// The last closed day and week, so the rollups are seen without a log reader
+static void ReportRollups(SamplingData* samplingData, LiquidCrystal lcd)
+{
+	DailyData*	day = LastClosedDay(&samplingData->rollups);
+	WeeklyData*	week = LastClosedWeek(&samplingData->rollups);
+
+	if (day == NULL)
+	{
+		lcd.setCursor(0, 0);
+		lcdPrint(lcd, F("No day closed yet"), 20);
+	}
+	else
+	{
+		ReportRollup(samplingData, lcd, 0, "Day", day, day->period);
 	}
+
+	if (week == NULL)
+	{
+		lcd.setCursor(0, 2);
+		lcdPrint(lcd, F("No week closed yet"), 20);
+	}
+	else
+	{
+		ReportRollup(samplingData, lcd, 2, "Wk", week, ROLLUP_WEEK_START(week->period));
+	}
+}
+
+
+// SRAM left between the top of the heap and the stack, measured from inside the
+// reporting call chain, so it is close to the worst case the loop sees.  The
+// hourly history is sized against this figure.
+static uint16_t FreeMemory()
+{
+	extern char		__heap_start;
+	extern char*	__brkval;
+	char			top;
+
+	return &top - (__brkval == NULL ? &__heap_start : __brkval);
+}
+
+
+float GetAverageTemp(uint8_t tempPin, float tempScale, uint8_t samples, uint16_t delayMillis) {
+	uint32_t rawTempSum = adc_sampler_collect(tempPin, samples, SamplingRate(delayMillis), ADC_SAMPLER_TIMED);
+
+	return rawTempSum / static_cast<float>(samples) * tempScale * 100.0 / 1024.0;
+}
+
+
+// The DS3231 refreshes its temperature every 64 seconds, so averaging repeated
+// reads gains nothing.  Ask for a fresh conversion only when it matters.
+// Returned as the register has it, in 0.25 C steps; formatQuarterDegrees()
+// turns it into display units.  *age (may be NULL) gets the seconds since
+// the value was read from the chip.
+int16_t GetDS3231Temp(bool fresh, uint32_t now, uint32_t* age) {
+	int16_t	quarterDegrees = 0;
+
+	DS3231_get_temperature(fresh ? DS3231_TEMP_FRESH : DS3231_TEMP_CACHED, now, &quarterDegrees, age);
+	return quarterDegrees;
+}
+
+
+// Samples are timed by the ADC sampler (one every delayMillis) while the CPU
+// idles, instead of delay() between analogRead() calls.
+float GetAverageRawVoltage(uint8_t voltagePin, uint8_t samples, uint16_t delayMillis) {
+	uint32_t rawVoltageSum = adc_sampler_collect(voltagePin, samples, SamplingRate(delayMillis), ADC_SAMPLER_TIMED);
+
 	return rawVoltageSum / static_cast<float>(samples);
 }
 
 
+// A raw reading with 10 + extraBits bits, from 4^extraBits samples.  The timed
+// mode is used on purpose: decimation needs a little noise on the input, which
+// a sleeping CPU would take away.
+uint16_t GetOversampledRawVoltage(uint8_t voltagePin, uint8_t extraBits, uint16_t rateHz) {
+	return adc_sampler_oversample(voltagePin, extraBits, rateHz, ADC_SAMPLER_TIMED | ADC_SAMPLER_DITHER);
+}
+
+
+uint16_t SamplingRate(uint16_t delayMillis) {
+	return (delayMillis == 0) ? 1000 : 1000 / delayMillis;
+}
+
+
 float GetAverageVoltage(uint8_t voltagePin, float voltageScale, uint8_t samples, uint16_t delayMillis) {
 	return GetAverageRawVoltage(voltagePin, samples, delayMillis) * voltageScale;
 }
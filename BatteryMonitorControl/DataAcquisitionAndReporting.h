@@ -15,44 +15,54 @@
 #include "DS3231Helpers.h"
 #include "DateTimeHelpers.h"
 #include "HourlyDataTypes.h"
-
-/*==========================+
-|	#defines				|
-+==========================*/
-#define DATA_HOURS				24
+#include "VoltageScaling.h"
+#include "VoltageFilter.h"
+#include "TempCompensation.h"
+#include "StateOfCharge.h"
 
 /*==========================+
 |	enums					|
 +==========================*/
 
-enum reportType { FirstReport = 0, Report0 = 0, Report1, Report2, Report3, EndOfReports };
+enum reportType { FirstReport = 0, Report0 = 0, Report1, Report2, Report3, Report4, EndOfReports };
 
 /*==========================+
 |	typedefs				|
 +==========================*/
 
+typedef HourlyHistory<24>	RecentHours;				// The closed hours kept, a day; each costs 21 bytes of SRAM with its tree nodes
+
 struct reportControlStruct
 {
-	DateTimeDS3231	previousTime;
+	uint32_t		previousTime;						// Epoch seconds of the last report page change
 	int				reportingCycle = FirstReport;
+	bool			displayFahrenheit = false;			// Temperatures on the report pages in F rather than C
 };
 typedef struct reportControlStruct ReportControl;
 
 
 struct samplingDataStruct
 {
-	DateTimeDS3231	timeEnabled;						// Time the voltage initially (re)enabled 
-	DateTimeDS3231	timeDisabled;						// Time the voltage initially dropped below the low threshold 
-	DateTimeDS3231	timeRecoveryStarted;				// Time the voltage started to rebound
-	DateTimeDS3231	recoveryTime;						// Time recovery will be completed
+	uint32_t		timeEnabled;						// Time (epoch seconds) the voltage initially (re)enabled 
+	uint32_t		timeDisabled;						// Time (epoch seconds) the voltage initially dropped below the low threshold 
+	uint32_t		timeRecoveryStarted;				// Time (epoch seconds) the voltage started to rebound
+	uint32_t		recoveryTime;						// Time (epoch seconds) recovery will be completed
 	CurrentHourData	currentHourData;					// Total, min, and max values for the current hour
-	HourlyData		hourlyData[DATA_HOURS];				//
+	RecentHours		hourlyHistory;						// The closed hours, and their lowest and highest
+	Rollups			rollups;							// Daily and weekly summaries of the closed hours
 	int8_t			currentHour = -1;					// The current hour.  Used to store/update samples
 	bool			isPowerOutDisabled = false;			// Indicates the power out has been disabled (the relay is open)
 	bool			isPowerOutRecovering = false;		// Indicates the power is recovering (the relay is still open)
 	bool			isIntialized = false;				// Indicates whether we're using startup logic
-	float			disableVoltage = 0;					// Voltage at which output power is disabled
-	float			enableVoltage = 0;					// Voltage at which output power is (re-)enabled
+	uint16_t		previousMillivolts = 0;				// Filtered voltage at the previous sample, for the slope
+	uint32_t		previousSampleTime = 0;				// Epoch seconds of the previous sample
+	uint16_t		wakeInterval;						// Seconds to the next sample, see ChooseWakeInterval()
+	bool			isInDip = false;					// The sleep watch tripped and the voltage hasn't recovered since
+	uint8_t			dipFollowUps = 0;					// Quick samples still to take after a dip
+	VoltageScale	voltageScale;						// Raw to millivolts, and the disable/enable thresholds
+	VoltageFilter	voltageFilter;						// Median and EMA of the raw readings, what power control acts on
+	uint8_t			temperatureBucket = TEMP_COMP_NONE;	// Threshold compensation bucket in use
+	StateOfCharge	stateOfCharge;						// Charge estimate and rate of fall, updated each sample
 };
 typedef struct samplingDataStruct SamplingData;
 
@@ -60,8 +70,13 @@ typedef struct samplingDataStruct SamplingData;
 struct currentSampleStruct
 {
 	DateTimeDS3231	timeNow;
-	float			tempSample;
-	float			scaledVoltage;
+	int16_t			tempSample;							// DS3231 temperature, 0.25 C steps
+	uint16_t		rawVoltage;							// This wake's reading
+	uint16_t		filteredVoltage;					// The filter's output after it, in the same raw units
+	uint16_t		millivolts;							// filteredVoltage in millivolts
+	uint8_t			socPercent;							// State of charge, or SOC_UNKNOWN
+	bool			socResting;							// socPercent is a rested (open-circuit) reading
+	uint16_t		minutesToCutoff;					// At the current rate of fall, or SOC_NO_CUTOFF
 	uint16_t		minutesDisabled = 0;
 };
 typedef struct currentSampleStruct CurrentSample;
@@ -72,9 +87,11 @@ typedef struct currentSampleStruct CurrentSample;
 +========================*/
 void DoReportingTasks(SamplingData* samplingData, CurrentSample* currentSample, ReportControl* reportControl, LiquidCrystal lcd, int8_t reportingDelaySeconds);
 float GetAverageRawVoltage(uint8_t voltagePin, uint8_t samples, uint16_t delayMillis);
+uint16_t GetOversampledRawVoltage(uint8_t voltagePin, uint8_t extraBits, uint16_t rateHz);
+uint16_t SamplingRate(uint16_t delayMillis);
 float GetAverageVoltage(uint8_t voltagePin, float voltageScale, uint8_t samples, uint16_t delayMillis);
 float GetAverageTemp(uint8_t tempPin, float tempScale, uint8_t samples, uint16_t delayMillis);
-float GetAverageDS3231Temp(uint8_t samples, uint16_t delayMillis);
+int16_t GetDS3231Temp(bool fresh, uint32_t now, uint32_t* age);
 
 
 #endif
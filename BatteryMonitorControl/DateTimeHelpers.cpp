@@ -49,22 +49,30 @@ int32_t dateDiffMinutes(DateTimeDS3231* pCurDayTime, DateTimeDS3231* pTgtDayTime
 
 int32_t dateDiffSeconds(DateTimeDS3231* pCurDayTime, DateTimeDS3231* pTgtDayTime)
 {
-	return ((((pCurDayTime->year - pTgtDayTime->year) * 365
-		+ (pCurDayTime->yday - pTgtDayTime->yday)) * 24
-		+ (pCurDayTime->hour - pTgtDayTime->hour)) * 60
-		+ (pCurDayTime->min - pTgtDayTime->min)) * 60
-		+ pCurDayTime->sec - pTgtDayTime->sec;
+	return (int32_t)(pCurDayTime->epoch - pTgtDayTime->epoch);
+}
+
+
+// The hour of the day (0..23) an epoch timestamp falls in
+uint8_t epochHour(uint32_t epoch)
+{
+	return (epoch / 3600) % 24;
 }
 
 
 #define sign(x) ((x > 0) ? 1 : ((x < 0) ? -1 : 0))
 
 ElapsedTime dateDiff(DateTimeDS3231* pCurDayTime, DateTimeDS3231* pTgtDayTime)
+{
+	return secondsToElapsed(dateDiffSeconds(pCurDayTime, pTgtDayTime));
+}
+
+
+ElapsedTime secondsToElapsed(int32_t elapsedSeconds)
 {
 	ElapsedTime elapsedTime;
-	int32_t elapsedSeconds = dateDiffSeconds(pCurDayTime, pTgtDayTime);
 	int8_t	dateSign = sign(elapsedSeconds);
-	int dividend = abs(elapsedSeconds);
+	int32_t dividend = labs(elapsedSeconds);
 
 	elapsedTime.totalSecond = elapsedSeconds;
 
@@ -103,6 +111,7 @@ void addSeconds(DateTimeDS3231* pCurDayTime, uint8_t seconds)
 		pCurDayTime->sec -= 60;
 		addMinutes(pCurDayTime, 1);
 	}
+	pCurDayTime->epoch = DS3231_epoch(pCurDayTime);
 }
 
 
@@ -116,6 +125,7 @@ void addMinutes(DateTimeDS3231* pCurDayTime, uint8_t minutes)
 		pCurDayTime->min -= 60;
 		addHours(pCurDayTime, 1);
 	}
+	pCurDayTime->epoch = DS3231_epoch(pCurDayTime);
 }
 
 
@@ -129,6 +139,7 @@ void addHours(DateTimeDS3231* pCurDayTime, uint8_t hours)
 		pCurDayTime->hour -= 24;
 		addDays(pCurDayTime, 1);
 	}
+	pCurDayTime->epoch = DS3231_epoch(pCurDayTime);
 }
 
 
@@ -143,6 +154,7 @@ void addDays(DateTimeDS3231* pCurDayTime, uint16_t days)
 		addYears(pCurDayTime, 1);
 	}
 	DDDtoMMDD(pCurDayTime, &pCurDayTime->mon, &pCurDayTime->mday);
+	pCurDayTime->epoch = DS3231_epoch(pCurDayTime);
 }
 
 
@@ -159,6 +171,7 @@ void addYears(DateTimeDS3231* pCurDayTime, uint8_t years)
 		pCurDayTime->mon = 3;
 		pCurDayTime->mday = 1;
 	}
+	pCurDayTime->epoch = DS3231_epoch(pCurDayTime);
 }
 
 
@@ -47,6 +47,8 @@ int32_t dateDiffSecondsSinceNow(DateTimeDS3231* pTgtDayTime);
 int32_t dateDiffMinutes(DateTimeDS3231* pCurDayTime, DateTimeDS3231* pTgtDayTime);
 int32_t dateDiffSeconds(DateTimeDS3231* pCurDayTime, DateTimeDS3231* pTgtDayTime);
 ElapsedTime dateDiff(DateTimeDS3231* pCurDayTime, DateTimeDS3231* pTgtDayTime);
+ElapsedTime secondsToElapsed(int32_t elapsedSeconds);
+uint8_t epochHour(uint32_t epoch);
 void addSeconds(DateTimeDS3231* pCurDayTime, uint8_t seconds);
 void addMinutes(DateTimeDS3231* pCurDayTime, uint8_t minutes);
 void addHours(DateTimeDS3231* pCurDayTime, uint8_t hours);
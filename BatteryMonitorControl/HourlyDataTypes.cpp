@@ -23,25 +23,92 @@
 #include "HourlyDataTypes.h"
 
 
-void PrepCurrentHour(CurrentHourData* hourData, DateTimeDS3231* t, uint16_t* rawVoltage, float* temp) {
+// Bins just wide enough, in powers of two, to cover lowRaw to highRaw.  Set
+// it before PrepCurrentHour(); it holds for the hour.
+void SetHistogramRange(VoltageHistogram* histogram, uint16_t lowRaw, uint16_t highRaw) {
+	uint8_t shift = 0;
+
+	while (((uint32_t)HISTOGRAM_BINS << shift) < (uint32_t)(highRaw - lowRaw)) {
+		shift++;
+	}
+	histogram->base = lowRaw;
+	histogram->shift = shift;
+}
+
+
+static void AddToHistogram(VoltageHistogram* histogram, uint16_t rawVoltage) {
+	uint16_t	bin = (rawVoltage < histogram->base) ? 0 : (rawVoltage - histogram->base) >> histogram->shift;
+
+	if (bin >= HISTOGRAM_BINS) {
+		bin = HISTOGRAM_BINS - 1;
+	}
+	if (histogram->bins[bin] == 0xFF) {
+		for (uint8_t i = 0; i < HISTOGRAM_BINS; i++) {
+			histogram->bins[i] = (histogram->bins[i] + 1) >> 1;
+		}
+	}
+	histogram->bins[bin]++;
+}
+
+
+// The raw voltage 'percent' of the way through the readings, interpolated
+// within its bin and kept within the hour's min and max
+uint16_t CurrentHourPercentile(CurrentHourData* hourData, uint8_t percent) {
+	VoltageHistogram*	histogram = &hourData->vHistogram;
+	uint32_t			total = 0;
+	uint32_t			target;
+	uint32_t			below = 0;
+	uint32_t			raw = hourData->vMin;
+
+	for (uint8_t i = 0; i < HISTOGRAM_BINS; i++) {
+		total += histogram->bins[i];
+	}
+	// In hundredths of a reading, so the position within a bin keeps its fraction
+	target = total * percent;
+	for (uint8_t i = 0; i < HISTOGRAM_BINS; i++) {
+		uint32_t in = histogram->bins[i] * 100UL;
+
+		if (in != 0 && below + in >= target) {
+			raw = histogram->base + ((uint32_t)i << histogram->shift) + (((target - below) << histogram->shift) + in / 2) / in;
+			break;
+		}
+		below += in;
+	}
+	return (raw < hourData->vMin) ? hourData->vMin : (raw > hourData->vMax) ? hourData->vMax : raw;
+}
+
+
+void PrepCurrentHour(CurrentHourData* hourData, DateTimeDS3231* t, uint16_t* rawVoltage, int16_t* temp) {
 	hourData->samples = 1;
 	hourData->hour = t->hour;
 	hourData->downMinutes = 0;
+	hourData->disableEvents = 0;
+	hourData->dipEvents = 0;
 	hourData->minMinute = t->min;
 	hourData->maxMinute = t->min;
 	hourData->vTotal = *rawVoltage;
+	hourData->vReference = *rawVoltage;
+	hourData->vSquares = 0;
 	hourData->vMin = *rawVoltage;
 	hourData->vMax = *rawVoltage;
 	hourData->tTotal = *temp;
 	hourData->tMin = *temp;
 	hourData->tMax = *temp;
+	hourData->tMinMinute = t->min;
+	hourData->tMaxMinute = t->min;
+	memset(hourData->vHistogram.bins, 0, sizeof(hourData->vHistogram.bins));
+	AddToHistogram(&hourData->vHistogram, *rawVoltage);
 }
 
 
-void AddSampleToCurrentHour(CurrentHourData* hourData, DateTimeDS3231* t, uint16_t* rawVoltage, float* temp) {
+void AddSampleToCurrentHour(CurrentHourData* hourData, DateTimeDS3231* t, uint16_t* rawVoltage, int16_t* temp) {
+
+	int16_t		difference = (int16_t)(*rawVoltage - hourData->vReference);
 
 	hourData->samples++;
 	hourData->vTotal += *rawVoltage;
+	hourData->vSquares += (uint32_t)((int32_t)difference * difference);
+	AddToHistogram(&hourData->vHistogram, *rawVoltage);
 
 	if (*rawVoltage < hourData->vMin) {
 		hourData->vMin = *rawVoltage;
@@ -58,102 +125,313 @@ void AddSampleToCurrentHour(CurrentHourData* hourData, DateTimeDS3231* t, uint16
 
 	if (*temp < hourData->tMin) {
 		hourData->tMin = *temp;
+		hourData->tMinMinute = t->min;
 	}
 	else {
 		if (*temp > hourData->tMax) {
 			hourData->tMax = *temp;
+			hourData->tMaxMinute = t->min;
+		}
+	}
+}
+
+
+// Integer division rounding halves away from zero, for signed totals
+static int16_t DivideRounded(int32_t total, uint16_t count) {
+	int32_t half = count / 2;
+
+	return (total < 0) ? (total - half) / count : (total + half) / count;
+}
+
+
+// Floor of the square root, a bit at a time, so no floating point is pulled in
+static uint32_t SquareRoot(uint64_t value) {
+	uint64_t	root = 0;
+	uint64_t	bit = (uint64_t)1 << 62;
+
+	while (bit > value) {
+		bit >>= 2;
+	}
+	while (bit != 0) {
+		if (value >= root + bit) {
+			value -= root + bit;
+			root = (root >> 1) + bit;
 		}
+		else {
+			root >>= 1;
+		}
+		bit >>= 2;
 	}
+	return (uint32_t)root;
+}
+
+
+// The squares are summed about the hour's first reading rather than the mean,
+// which isn't known until the hour closes.  With d the differences from it,
+// n * variance = sum(d^2) - sum(d)^2 / n, so stddev = sqrt(n sum(d^2) - sum(d)^2) / n.
+// The sums are exact integers, and a 64-bit sum of squares can't wrap even at
+// 1800 full-scale samples, so there's nothing for the old running-mean (Welford)
+// form to protect against here.
+static uint16_t StandardDeviation(CurrentHourData* hourData) {
+	int64_t		differences = (int64_t)hourData->vTotal - (int64_t)hourData->vReference * hourData->samples;
+	uint64_t	spread;
+	uint32_t	deviation;
+
+	if (hourData->samples < 2) {
+		return 0;
+	}
+	spread = hourData->vSquares * hourData->samples - (uint64_t)(differences * differences);
+	deviation = (SquareRoot(spread * HOURLY_STDDEV_SCALE * HOURLY_STDDEV_SCALE) + hourData->samples / 2) / hourData->samples;
+	return (deviation > 0xFFFF) ? 0xFFFF : deviation;
 }
 
 
 void prepHourlyDataSlot(HourlyData* hourlyDataSlot) {
-	hourlyDataSlot->hour = 0xFF;
+	hourlyDataSlot->hour = HOURLY_NO_HOUR;
 	hourlyDataSlot->downMinutes = 0;
+	hourlyDataSlot->disableEvents = 0;
+	hourlyDataSlot->dipEvents = 0;
 	hourlyDataSlot->minMinute = 0;
 	hourlyDataSlot->maxMinute = 0;
-	hourlyDataSlot->vMin = 0xFFFF;
-	hourlyDataSlot->vMax = 0;
-	hourlyDataSlot->tMin = 3E+38;
-	hourlyDataSlot->tMax = -3E+38;
+	hourlyDataSlot->vMin = 0;
+	hourlyDataSlot->vAvgAbove = 0;
+	hourlyDataSlot->vMaxAbove = 0;
+	hourlyDataSlot->vSpread = 0;
+	hourlyDataSlot->tMinHalves = 0;
+	hourlyDataSlot->tMaxHalves = 0;
+	hourlyDataSlot->tAvgHalves = 0;
+	hourlyDataSlot->vP10Above = 0;
+	hourlyDataSlot->vP50Above = 0;
+	hourlyDataSlot->vP90Above = 0;
+	hourlyDataSlot->tMinMinute = 0;
+	hourlyDataSlot->tMaxMinute = 0;
 }
 
 
-void PrepHourlyData(HourlyData* firstHourlyDataSlot, uint8_t count) {
-	for (int i = 0; i < count; i++) {
-		prepHourlyDataSlot(firstHourlyDataSlot + i);
+// Whether slot a is more extreme than slot b; an empty slot never wins
+static bool IsMoreExtreme(HourlyData* hourSlots, uint8_t extreme, uint8_t a, uint8_t b) {
+	if (hourSlots[a].hour == HOURLY_NO_HOUR) {
+		return false;
+	}
+	if (hourSlots[b].hour == HOURLY_NO_HOUR) {
+		return true;
+	}
+	switch (extreme) {
+	case MinVoltage:
+		return HourlyVMin(&hourSlots[a]) < HourlyVMin(&hourSlots[b]);
+	case MaxVoltage:
+		return HourlyVMax(&hourSlots[a]) > HourlyVMax(&hourSlots[b]);
+	case MinTemp:
+		return hourSlots[a].tMinHalves < hourSlots[b].tMinHalves;
+	default:
+		return hourSlots[a].tMaxHalves > hourSlots[b].tMaxHalves;
 	}
 }
 
 
+// The slot a node stands for: its stored winner, or the slot itself for a leaf
+static uint8_t ExtremeSlot(uint8_t* extremeNodes, uint8_t extreme, uint8_t node, uint8_t count) {
+	return (node >= count) ? node - count : extremeNodes[extreme * count + node];
+}
 
 
-void CloseCurrentHour(HourlyData* hourlyData, CurrentHourData* currentHourData, uint8_t hourIndex) {
-	// Finalize Current Hour, save in Hourly Data
-	hourlyData[hourIndex].hour = currentHourData->hour;
-	hourlyData[hourIndex].downMinutes = currentHourData->downMinutes;
-	hourlyData[hourIndex].minMinute = currentHourData->minMinute;
-	hourlyData[hourIndex].maxMinute = currentHourData->maxMinute;
-	hourlyData[hourIndex].vMin = currentHourData->vMin;
-	hourlyData[hourIndex].vMax = currentHourData->vMax;
-	hourlyData[hourIndex].vAvg = (currentHourData->samples == 0) ? 0.0 : round(static_cast<double>(currentHourData->vTotal) / currentHourData->samples);
-	hourlyData[hourIndex].tMin = currentHourData->tMin;
-	hourlyData[hourIndex].tMax = currentHourData->tMax;
-	hourlyData[hourIndex].tAvg = (currentHourData->samples == 0) ? 0.0 : currentHourData->tTotal / currentHourData->samples;
+static void UpdateExtremeNode(uint8_t* extremeNodes, HourlyData* hourSlots, uint8_t node, uint8_t count) {
+	for (uint8_t extreme = 0; extreme < HourlyExtremeCount; extreme++) {
+		uint8_t left = ExtremeSlot(extremeNodes, extreme, 2 * node, count);
+		uint8_t right = ExtremeSlot(extremeNodes, extreme, 2 * node + 1, count);
+
+		extremeNodes[extreme * count + node] = IsMoreExtreme(hourSlots, extreme, right, left) ? right : left;
+	}
 }
 
 
-HourlyData* FindMinVoltage(HourlyData* hourSlots, uint8_t count) {
-	HourlyData* minVoltageData = NULL;
-	uint16_t	minVoltage = 0xFFFF;
+// Replays the nodes from a changed slot up to the root
+static void UpdateExtremePath(uint8_t* extremeNodes, HourlyData* hourSlots, uint8_t hourIndex, uint8_t count) {
+	for (uint8_t node = (count + hourIndex) / 2; node >= 1; node /= 2) {
+		UpdateExtremeNode(extremeNodes, hourSlots, node, count);
+	}
+}
 
-	for (int i = 0; i < count; i++) {
-		if (hourSlots[i].hour != 0xFF && hourSlots[i].vMin < minVoltage) {
-			minVoltage = hourSlots[i].vMin;
-			minVoltageData = &hourSlots[i];
-		}
+
+void CloseCurrentHour(HourlyData* hourlyData, CurrentHourData* currentHourData, uint8_t hourIndex, uint8_t* extremeNodes, uint8_t count) {
+	HourlyData*	hourData = &hourlyData[hourIndex];
+	uint16_t	vAvg = (currentHourData->samples == 0) ? 0 : (currentHourData->vTotal + currentHourData->samples / 2) / currentHourData->samples;
+	int16_t		tAvg = (currentHourData->samples == 0) ? 0 : DivideRounded(currentHourData->tTotal, currentHourData->samples);
+	uint16_t	vStdDev = StandardDeviation(currentHourData);
+
+	// Finalize Current Hour, save in Hourly Data (packed, see HourlyData)
+	hourData->hour = currentHourData->hour;
+	hourData->downMinutes = (currentHourData->downMinutes > 60) ? 60 : currentHourData->downMinutes;
+	hourData->disableEvents = (currentHourData->disableEvents > 31) ? 31 : currentHourData->disableEvents;
+	hourData->dipEvents = currentHourData->dipEvents;
+	hourData->minMinute = currentHourData->minMinute;
+	hourData->maxMinute = currentHourData->maxMinute;
+	hourData->vMin = currentHourData->vMin;
+	hourData->vAvgAbove = EncodeVoltageAbove(currentHourData->vMin, vAvg);
+	hourData->vMaxAbove = EncodeVoltageAbove(currentHourData->vMin, currentHourData->vMax);
+	vStdDev = (vStdDev + HOURLY_SPREAD_UNIT / 2) / HOURLY_SPREAD_UNIT;
+	hourData->vSpread = (vStdDev > 0xFF) ? 0xFF : vStdDev;
+	hourData->tMinHalves = EncodeHalfDegrees(currentHourData->tMin);
+	hourData->tMaxHalves = EncodeHalfDegrees(currentHourData->tMax);
+	hourData->tAvgHalves = EncodeHalfDegrees(tAvg);
+	hourData->vP10Above = EncodeVoltageAbove(currentHourData->vMin, CurrentHourPercentile(currentHourData, 10));
+	hourData->vP50Above = EncodeVoltageAbove(currentHourData->vMin, CurrentHourPercentile(currentHourData, 50));
+	hourData->vP90Above = EncodeVoltageAbove(currentHourData->vMin, CurrentHourPercentile(currentHourData, 90));
+	hourData->tMinMinute = currentHourData->tMinMinute;
+	hourData->tMaxMinute = currentHourData->tMaxMinute;
+
+	UpdateExtremePath(extremeNodes, hourlyData, hourIndex, count);
+}
+
+
+// Empties a slot for an hour that was never closed, so it can't win an extreme
+void ClearHourlySlot(HourlyData* hourlyData, uint8_t hourIndex, uint8_t* extremeNodes, uint8_t count) {
+	prepHourlyDataSlot(&hourlyData[hourIndex]);
+	UpdateExtremePath(extremeNodes, hourlyData, hourIndex, count);
+}
+
+
+static void ClearRollupTotals(RollupTotals* totals) {
+	totals->period = ROLLUP_NONE;
+	totals->count = 0;
+	totals->downMinutes = 0;
+	totals->disableEvents = 0;
+	totals->vMin = 0xFFFF;
+	totals->vMax = 0;
+	totals->vTotal = 0;
+	totals->tMin = INT16_MAX;
+	totals->tMax = INT16_MIN;
+	totals->tTotal = 0;
+}
+
+
+static void AddToRollupTotals(RollupTotals* totals, uint16_t period, uint16_t downMinutes, uint16_t disableEvents,
+		uint16_t vMin, uint16_t vMax, uint16_t vAvg, int16_t tMin, int16_t tMax, int16_t tAvg) {
+	totals->period = period;
+	totals->count++;
+	totals->downMinutes += downMinutes;
+	totals->disableEvents += disableEvents;
+	if (vMin < totals->vMin) {
+		totals->vMin = vMin;
 	}
-	return minVoltageData;
+	if (vMax > totals->vMax) {
+		totals->vMax = vMax;
+	}
+	totals->vTotal += vAvg;
+	if (tMin < totals->tMin) {
+		totals->tMin = tMin;
+	}
+	if (tMax > totals->tMax) {
+		totals->tMax = tMax;
+	}
+	totals->tTotal += tAvg;
 }
 
 
-HourlyData* FindMinTemp(HourlyData* hourSlots, uint8_t count) {
-	HourlyData* minTempData = NULL;
-	float	minTemp = 3E+38;
+static void CloseRollupTotals(RollupTotals* totals, RollupData* rollup) {
+	rollup->period = totals->period;
+	rollup->count = totals->count;
+	rollup->downMinutes = totals->downMinutes;
+	rollup->disableEvents = totals->disableEvents;
+	rollup->vMin = totals->vMin;
+	rollup->vMax = totals->vMax;
+	rollup->vAvg = (totals->vTotal + totals->count / 2) / totals->count;
+	rollup->tMin = totals->tMin;
+	rollup->tMax = totals->tMax;
+	rollup->tAvg = DivideRounded(totals->tTotal, totals->count);
+	ClearRollupTotals(totals);
+}
 
-	for (int i = 0; i < count; i++) {
-		if (hourSlots[i].hour != 0xFF && hourSlots[i].tMin < minTemp) {
-			minTemp = hourSlots[i].tMin;
-			minTempData = &hourSlots[i];
-		}
+
+void InitRollups(Rollups* rollups) {
+	ClearRollupTotals(&rollups->today);
+	ClearRollupTotals(&rollups->thisWeek);
+	for (int i = 0; i < DATA_DAYS; i++) {
+		rollups->dailyData[i].period = ROLLUP_NONE;
 	}
-	return minTempData;
+	for (int i = 0; i < DATA_WEEKS; i++) {
+		rollups->weeklyData[i].period = ROLLUP_NONE;
+	}
+	rollups->nextDay = 0;
+	rollups->nextWeek = 0;
 }
 
 
-HourlyData* FindMaxVoltage(HourlyData* hourSlots, uint8_t count) {
-	HourlyData* maxVoltageData = NULL;
-	uint16_t	maxVoltage = 0xFFFF;
+static void CloseWeek(Rollups* rollups) {
+	if (rollups->thisWeek.count != 0) {
+		CloseRollupTotals(&rollups->thisWeek, &rollups->weeklyData[rollups->nextWeek]);
+		rollups->nextWeek = (rollups->nextWeek + 1) % DATA_WEEKS;
+	}
+}
 
-	for (int i = 0; i < count; i++) {
-		if (hourSlots[i].hour != 0xFF && hourSlots[i].vMax > maxVoltage) {
-			maxVoltage = hourSlots[i].vMax;
-			maxVoltageData = &hourSlots[i];
-		}
+
+// 'nextDay' is the day now starting, which may also start a new week
+static void CloseDay(Rollups* rollups, uint16_t nextDay) {
+	DailyData*	day = &rollups->dailyData[rollups->nextDay];
+	uint16_t	week;
+
+	if (rollups->today.count == 0) {
+		return;
+	}
+	CloseRollupTotals(&rollups->today, day);
+	rollups->nextDay = (rollups->nextDay + 1) % DATA_DAYS;
+
+	week = ROLLUP_WEEK(day->period);
+	if (rollups->thisWeek.period != week) {
+		CloseWeek(rollups);
+	}
+	AddToRollupTotals(&rollups->thisWeek, week, day->downMinutes, day->disableEvents,
+		day->vMin, day->vMax, day->vAvg, day->tMin, day->tMax, day->tAvg);
+	if (ROLLUP_WEEK(nextDay) != week) {
+		CloseWeek(rollups);
 	}
-	return maxVoltageData;
 }
 
 
-HourlyData* FindMaxTemp(HourlyData* hourSlots, uint8_t count) {
-	HourlyData* maxTempData = NULL;
-	float	maxTemp = -3E+38;
+// Folds a just-closed hour into today's totals.  'hourEpoch' is any time in
+// that hour and 'nowEpoch' the time now; when they fall on different days the
+// day is closed straight away rather than at the next hour's close.
+void RollUpHour(Rollups* rollups, HourlyData* hourData, uint32_t hourEpoch, uint32_t nowEpoch) {
+	uint16_t	day = hourEpoch / SECONDS_PER_DAY;
+	uint16_t	today = nowEpoch / SECONDS_PER_DAY;
 
-	for (int i = 0; i < count; i++) {
-		if (hourSlots[i].hour != 0xFF && hourSlots[i].tMax > maxTemp) {
-			maxTemp = hourSlots[i].tMax;
-			maxTempData = &hourSlots[i];
-		}
+	// A day we slept through the end of
+	if (rollups->today.count != 0 && rollups->today.period != day) {
+		CloseDay(rollups, day);
+	}
+	AddToRollupTotals(&rollups->today, day, hourData->downMinutes, hourData->disableEvents,
+		HourlyVMin(hourData), HourlyVMax(hourData), HourlyVAvg(hourData), HourlyTMin(hourData), HourlyTMax(hourData), HourlyTAvg(hourData));
+	if (today != day) {
+		CloseDay(rollups, today);
 	}
-	return maxTempData;
-}
\ No newline at end of file
+}
+
+
+// The most recently closed day, or NULL before the first one has closed
+DailyData* LastClosedDay(Rollups* rollups) {
+	DailyData* day = &rollups->dailyData[(rollups->nextDay + DATA_DAYS - 1) % DATA_DAYS];
+
+	return (day->period == ROLLUP_NONE) ? NULL : day;
+}
+
+
+// The most recently closed week, or NULL before the first one has closed
+WeeklyData* LastClosedWeek(Rollups* rollups) {
+	WeeklyData* week = &rollups->weeklyData[(rollups->nextWeek + DATA_WEEKS - 1) % DATA_WEEKS];
+
+	return (week->period == ROLLUP_NONE) ? NULL : week;
+}
+
+
+void InitHourlyExtremes(uint8_t* extremeNodes, HourlyData* hourSlots, uint8_t count) {
+	for (uint8_t node = count - 1; node >= 1; node--) {
+		UpdateExtremeNode(extremeNodes, hourSlots, node, count);
+	}
+}
+
+
+HourlyData* FindExtreme(HourlyData* hourSlots, uint8_t* extremeNodes, uint8_t count, uint8_t extreme) {
+	uint8_t slot = (count == 1) ? 0 : extremeNodes[extreme * count + 1];
+
+	return (hourSlots[slot].hour == HOURLY_NO_HOUR) ? NULL : &hourSlots[slot];
+}
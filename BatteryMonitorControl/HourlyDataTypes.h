@@ -26,44 +26,278 @@
 
 #include "Arduino.h"
 #include "ds3231.h"
+#include "HourlyRing.h"
+#include "VoltageScaling.h"
+
+#define HOURLY_STDDEV_SCALE	16		// vStdDev is kept in 1/16 raw count steps
+#define DATA_DAYS			7		// Daily rollups kept
+#define DATA_WEEKS			4		// Weekly rollups kept
+#define SECONDS_PER_DAY		86400UL
+#define ROLLUP_NONE			0xFFFF	// period of an empty rollup
+#define ROLLUP_WEEK(day)	(((day) + 5) / 7)	// Weeks since 1.1.2000, Monday to Sunday (1.1.2000 was a Saturday)
+#define ROLLUP_WEEK_START(week)	((week) * 7 - 5)	// The Monday a week starts on, in days
+#define HISTOGRAM_BINS		16
+
+/*
+  Where the hour's readings fell, for percentiles.  HISTOGRAM_BINS bins of
+  1 << shift raw counts from base; the end bins also take everything below
+  and above.  Adding a reading is a shift and an increment.  When a bin would
+  pass 255 every bin is halved instead, so the shape survives a long hour of
+  fast samples (rounding up, so a rare reading isn't lost).
+*/
+struct voltageHistogramStruct {
+	uint16_t	base;					// Raw count at the bottom of bin 0
+	uint8_t		shift;					// Bins are 1 << shift raw counts wide
+	uint8_t		bins[HISTOGRAM_BINS];
+};
+typedef struct voltageHistogramStruct VoltageHistogram;
 
 struct currentHourDataStruct {
   uint8_t   hour;			// The hour this represents
   uint8_t   minMinute;		// The minute the vMin was recorded
   uint8_t   maxMinute;		// The minute the vMax was recorded
-  uint8_t   samples;		// The number of samples
+  uint16_t  samples;		// The number of samples, up to 1800 at 2 second wakes
   uint8_t	downMinutes;	// Number of minutes this hour the power was down
-  uint16_t  vTotal;			// The total of raw voltage readings
+  uint8_t	disableEvents;	// Number of times this hour the power was disabled
+  uint8_t	dipEvents;		// Number of sags the sleep watch woke us for this hour
+  uint32_t  vTotal;			// The total of raw voltage readings
+  uint16_t  vReference;		// The hour's first reading, what vSquares is taken about
+  uint64_t  vSquares;		// The total of squared differences from vReference
   uint16_t  vMin;			// The minimum raw voltage this hour
   uint16_t  vMax;			// The maximum raw voltage this hour
-  float		tTotal;			// The total of raw temperature readings
-  float		tMin;			// The minimum raw temperature this hour
-  float		tMax;			// The maximum raw temperature this hour
+  int32_t	tTotal;			// The total of temperature readings, 0.25 C steps
+  int16_t	tMin;			// The minimum temperature this hour, 0.25 C steps
+  int16_t	tMax;			// The maximum temperature this hour, 0.25 C steps
+  uint8_t	tMinMinute;		// The minute the tMin was recorded
+  uint8_t	tMaxMinute;		// The minute the tMax was recorded
+  VoltageHistogram vHistogram;	// The raw voltage readings this hour, see SetHistogramRange()
 };
 typedef struct currentHourDataStruct CurrentHourData;
 
+/*
+  A closed hour, packed to 17 bytes since every slot of history is SRAM.  The
+  minimum voltage is kept whole, and the average, maximum and the histogram's
+  10/50/90th percentiles as a byte each above it, in HOURLY_VOLTAGE_UNIT
+  steps: one 10 bit count (about 23 mV) whatever VOLTAGE_EXTRA_BITS is, so
+  255 of them (about 5.9 V) cover any hour a 12 V battery has.  The minimum,
+  which the power decisions turn on, is exact.  Temperatures are whole bytes of
+  0.5 C (-64 to +63.5 C); the small counts and minutes are bit fields.  Read
+  the encoded figures through the HourlyVMin()... accessors below, which give
+  the units CurrentHourData uses; the bit fields read directly.
+*/
+#define HOURLY_NO_HOUR			0x1F	// hour of an empty slot
+#define HOURLY_DELTA_MAX		0xFF
+#define HOURLY_VOLTAGE_UNIT		(1 << VOLTAGE_EXTRA_BITS)						// raw counts per step above vMin
+#define HOURLY_SPREAD_UNIT		((HOURLY_STDDEV_SCALE / 4) << VOLTAGE_EXTRA_BITS)	// vSpread steps (1/4 of a 10 bit count) in vStdDev steps
+
 struct hourlyDataStruct {
-	uint8_t		hour;			// The hour this represents
-	uint8_t		downMinutes;	// Number of minutes this hour the power was down
-	uint8_t		minMinute;		// The minute the vMin was recorded
-	uint8_t		maxMinute;		// The minute the vMax was recorded
-	uint16_t	vMin;			// The minimum raw voltage this hour
-	uint16_t	vMax;			// The maximum raw voltage this hour
-	uint16_t	vAvg;			// The average raw voltage this hour
-	float  		tMin;			// The minimum raw temperature this hour
-	float  		tMax;			// The maximum raw temperature this hour
-	float		tAvg;			// The average raw temperature this hour
-};
+	uint16_t	vMin;				// The minimum raw voltage this hour
+	uint8_t		vAvgAbove;			// The average raw voltage this hour - vMin
+	uint8_t		vMaxAbove;			// The maximum raw voltage this hour - vMin
+	uint8_t		vSpread;			// The standard deviation of the raw voltage, see HOURLY_SPREAD_UNIT
+	int8_t		tMinHalves;			// The minimum temperature this hour, 0.5 C steps
+	int8_t		tMaxHalves;			// The maximum temperature this hour, 0.5 C steps
+	int8_t		tAvgHalves;			// The average temperature this hour, 0.5 C steps
+	uint8_t		vP10Above;			// The 10th percentile raw voltage - vMin
+	uint8_t		vP50Above;			// The median raw voltage - vMin
+	uint8_t		vP90Above;			// The 90th percentile raw voltage - vMin
+	uint8_t		dipEvents;			// Number of sags the sleep watch woke us for this hour
+	uint16_t	hour : 5;			// The hour this represents, HOURLY_NO_HOUR if empty
+	uint16_t	downMinutes : 6;	// Number of minutes this hour the power was down
+	uint16_t	disableEvents : 5;	// Number of times this hour the power was disabled, up to 31
+	uint32_t	minMinute : 6;		// The minute the vMin was recorded
+	uint32_t	maxMinute : 6;		// The minute the vMax was recorded
+	uint32_t	tMinMinute : 6;		// The minute the tMin was recorded
+	uint32_t	tMaxMinute : 6;		// The minute the tMax was recorded
+} __attribute__((packed));
 typedef struct hourlyDataStruct HourlyData;
 
-void PrepCurrentHour(CurrentHourData* hourData, DateTimeDS3231* t, uint16_t* rawVoltage, float* temp);
-void AddSampleToCurrentHour(CurrentHourData* hourData, DateTimeDS3231* t, uint16_t* rawVoltage, float* temp);
+static_assert(sizeof(HourlyData) == 17, "HourlyData should pack into 17 bytes");
+
+inline int8_t EncodeHalfDegrees(int16_t quarterDegrees) {
+	int16_t halves = (quarterDegrees < 0) ? (quarterDegrees - 1) / 2 : (quarterDegrees + 1) / 2;
+
+	return (halves < INT8_MIN) ? INT8_MIN : (halves > INT8_MAX) ? INT8_MAX : halves;
+}
+
+inline int16_t DecodeHalfDegrees(int8_t halves) {
+	return (int16_t)halves * 2;
+}
+
+// 'to' above 'from' in HOURLY_VOLTAGE_UNIT steps, rounded and saturating
+inline uint8_t EncodeVoltageAbove(uint16_t from, uint16_t to) {
+	uint16_t steps = (to <= from) ? 0 : (to - from + HOURLY_VOLTAGE_UNIT / 2) >> VOLTAGE_EXTRA_BITS;
+
+	return (steps > HOURLY_DELTA_MAX) ? HOURLY_DELTA_MAX : steps;
+}
+
+inline uint16_t DecodeVoltageAbove(uint16_t from, uint8_t above) {
+	return from + ((uint16_t)above << VOLTAGE_EXTRA_BITS);
+}
+
+inline uint16_t HourlyVMin(const HourlyData* hourData) {
+	return hourData->vMin;
+}
+
+inline uint16_t HourlyVAvg(const HourlyData* hourData) {
+	return DecodeVoltageAbove(hourData->vMin, hourData->vAvgAbove);
+}
+
+inline uint16_t HourlyVMax(const HourlyData* hourData) {
+	return DecodeVoltageAbove(hourData->vMin, hourData->vMaxAbove);
+}
+
+// 1/HOURLY_STDDEV_SCALE raw count steps, as the hour was closed with
+inline uint16_t HourlyVStdDev(const HourlyData* hourData) {
+	return (uint16_t)hourData->vSpread * HOURLY_SPREAD_UNIT;
+}
+
+// Percentiles of the raw voltage, from the hour's histogram
+inline uint16_t HourlyVP10(const HourlyData* hourData) {
+	return DecodeVoltageAbove(hourData->vMin, hourData->vP10Above);
+}
+
+inline uint16_t HourlyVP50(const HourlyData* hourData) {
+	return DecodeVoltageAbove(hourData->vMin, hourData->vP50Above);
+}
+
+inline uint16_t HourlyVP90(const HourlyData* hourData) {
+	return DecodeVoltageAbove(hourData->vMin, hourData->vP90Above);
+}
+
+// Temperatures in 0.25 C steps
+inline int16_t HourlyTMin(const HourlyData* hourData) {
+	return DecodeHalfDegrees(hourData->tMinHalves);
+}
+
+inline int16_t HourlyTMax(const HourlyData* hourData) {
+	return DecodeHalfDegrees(hourData->tMaxHalves);
+}
+
+inline int16_t HourlyTAvg(const HourlyData* hourData) {
+	return DecodeHalfDegrees(hourData->tAvgHalves);
+}
+
+enum hourlyExtreme { MinVoltage = 0, MaxVoltage, MinTemp, MaxTemp, HourlyExtremeCount };
+
+/*
+  Hours roll up into days and days into weeks, each kept in a fixed ring.  A
+  day is folded one closed hour at a time into running totals, and closed
+  into the daily ring when the date changes; the closed day is folded into
+  the week's totals the same way.  Nothing is rescanned, and the RAM used is
+  fixed by DATA_DAYS and DATA_WEEKS.  Averages are of the hourly (daily)
+  averages, each hour (day) counting the same.
+*/
+struct rollupDataStruct {
+	uint16_t	period;			// Days (or weeks, see ROLLUP_WEEK) since 1.1.2000, ROLLUP_NONE if empty
+	uint8_t		count;			// Hours (days) folded in
+	uint16_t	downMinutes;	// Minutes the power was down
+	uint16_t	disableEvents;	// Times the power was disabled
+	uint16_t	vMin;			// The minimum raw voltage
+	uint16_t	vMax;			// The maximum raw voltage
+	uint16_t	vAvg;			// The average raw voltage
+	int16_t		tMin;			// The minimum temperature, 0.25 C steps
+	int16_t		tMax;			// The maximum temperature, 0.25 C steps
+	int16_t		tAvg;			// The average temperature, 0.25 C steps
+};
+typedef struct rollupDataStruct RollupData;
+typedef RollupData DailyData;
+typedef RollupData WeeklyData;
+
+struct rollupTotalsStruct {
+	uint16_t	period;			// As RollupData
+	uint8_t		count;
+	uint16_t	downMinutes;
+	uint16_t	disableEvents;
+	uint16_t	vMin;
+	uint16_t	vMax;
+	uint32_t	vTotal;			// The total of the averages folded in
+	int16_t		tMin;
+	int16_t		tMax;
+	int32_t		tTotal;
+};
+typedef struct rollupTotalsStruct RollupTotals;
+
+struct rollupsStruct {
+	RollupTotals	today;					// The day being collected
+	DailyData		dailyData[DATA_DAYS];
+	uint8_t			nextDay;				// dailyData slot the next closed day goes in
+	RollupTotals	thisWeek;				// The week being collected
+	WeeklyData		weeklyData[DATA_WEEKS];
+	uint8_t			nextWeek;				// weeklyData slot the next closed week goes in
+};
+typedef struct rollupsStruct Rollups;
+
+void PrepCurrentHour(CurrentHourData* hourData, DateTimeDS3231* t, uint16_t* rawVoltage, int16_t* temp);
+void AddSampleToCurrentHour(CurrentHourData* hourData, DateTimeDS3231* t, uint16_t* rawVoltage, int16_t* temp);
+void SetHistogramRange(VoltageHistogram* histogram, uint16_t lowRaw, uint16_t highRaw);
+uint16_t CurrentHourPercentile(CurrentHourData* hourData, uint8_t percent);
 void prepHourlyDataSlot(HourlyData *hourlyDataSlot);
-void PrepHourlyData(HourlyData *firstHourlyDataSlot, uint8_t count);
-void CloseCurrentHour(HourlyData* hourlyData, CurrentHourData* currentHourData, uint8_t hourIndex);
-HourlyData* FindMinVoltage(HourlyData* hourSlots, uint8_t count);
-HourlyData* FindMinTemp(HourlyData* hourSlots, uint8_t count);
-HourlyData* FindMaxVoltage(HourlyData* hourSlots, uint8_t count);
-HourlyData* FindMaxTemp(HourlyData* hourSlots, uint8_t count);
+void CloseCurrentHour(HourlyData* hourlyData, CurrentHourData* currentHourData, uint8_t hourIndex, uint8_t* extremeNodes, uint8_t count);
+void ClearHourlySlot(HourlyData* hourlyData, uint8_t hourIndex, uint8_t* extremeNodes, uint8_t count);
+void InitHourlyExtremes(uint8_t* extremeNodes, HourlyData* hourSlots, uint8_t count);
+HourlyData* FindExtreme(HourlyData* hourSlots, uint8_t* extremeNodes, uint8_t count, uint8_t extreme);
+void InitRollups(Rollups* rollups);
+void RollUpHour(Rollups* rollups, HourlyData* hourData, uint32_t hourEpoch, uint32_t nowEpoch);
+DailyData* LastClosedDay(Rollups* rollups);
+WeeklyData* LastClosedWeek(Rollups* rollups);
+
+// What HourlyRing needs of its slots
+inline bool IsEmptySlot(const HourlyData* hourData) {
+	return hourData->hour == HOURLY_NO_HOUR;
+}
+
+inline void ClearSlot(HourlyData* hourData) {
+	prepHourlyDataSlot(hourData);
+}
+
+/*
+  The closed hours, with the lowest and highest voltage and temperature
+  across them kept without scanning.  Each extreme has a small segment tree
+  over the slots: node i holds whichever slot wins between nodes 2i and 2i+1,
+  and node N + s is slot s itself, so only the inner nodes 1..N-1 are stored.
+  Closing an hour replays the path from its slot up to node 1, the answer.
+  The tree code itself isn't a template, so each size adds only its storage.
+  Hours that were never closed (power off, reporting, a long sleep) are
+  emptied when the next one is, so their slots don't keep the figures from
+  N hours before.
+*/
+#define HOURLY_NO_EPOCH_HOUR	0xFFFFFFFFUL	// lastEpochHour before any hour is closed
+
+template <uint8_t N>
+class HourlyHistory : public HourlyRing<N, HourlyData> {
+public:
+	void clear() {
+		HourlyRing<N, HourlyData>::clear();
+		InitHourlyExtremes(extremeNodes, this->slots, N);
+		lastEpochHour = HOURLY_NO_EPOCH_HOUR;
+	}
+
+	// Stores the current hour in the slot for 'epochHour' and returns it,
+	// first emptying the slots of any hours since the last one closed
+	HourlyData* close(CurrentHourData* currentHourData, uint32_t epochHour) {
+		uint8_t index = this->slotFor(epochHour);
+
+		if (lastEpochHour != HOURLY_NO_EPOCH_HOUR && epochHour > lastEpochHour + 1) {
+			uint32_t skipped = epochHour - lastEpochHour - 1;
+
+			for (uint32_t hour = epochHour - ((skipped > N) ? N : skipped); hour < epochHour; hour++) {
+				ClearHourlySlot(this->slots, this->slotFor(hour), extremeNodes, N);
+			}
+		}
+		lastEpochHour = epochHour;
+		CloseCurrentHour(this->slots, currentHourData, index, extremeNodes, N);
+		return &this->slots[index];
+	}
+
+	// The slot holding an hourlyExtreme, NULL while every slot is empty
+	HourlyData* find(uint8_t extreme) {
+		return FindExtreme(this->slots, extremeNodes, N, extreme);
+	}
+
+private:
+	uint8_t		extremeNodes[HourlyExtremeCount * N];	// Winning slot per inner node, extreme * N + node
+	uint32_t	lastEpochHour;							// Epoch hour last closed, HOURLY_NO_EPOCH_HOUR if none
+};
 
 #endif
@@ -0,0 +1,139 @@
+/**
+ *  My Extension to some open source application
+ *
+ *  Copyright 2022 by Edward Figarsky <efigarsky@gmail.com>
+ *
+ * This file is part of an open source application.
+ *
+ * Some open source application is free software: you can redistribute
+ * it and/or modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * Some open source application is distributed in the hope that it will
+ * be useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * @license GPL-3.0+ <http://spdx.org/licenses/GPL-3.0+>
+ */
+#pragma once
+#ifndef _HourlyRing_h_
+#define _HourlyRing_h_
+
+#include "Arduino.h"
+
+/*
+  A fixed ring of N slots, one per hour, for any slot type.  The slot for an
+  hour is its hour count (epoch / 3600) modulo N, so N needn't divide a day;
+  with N a power of two that is a mask, and either way N is a constant the
+  compiler folds in.
+
+  SampleT supplies two overloads, found by argument lookup:
+	bool IsEmptySlot(const SampleT* slot);		// nothing closed into it yet
+	void ClearSlot(SampleT* slot);				// make it empty
+
+  Iteration, minBy(), maxBy() and fold() skip empty slots.  A key for
+  minBy()/maxBy() is either a member pointer (&HourlyData::vMin) or an
+  accessor taking a const SampleT* (HourlyVMin); both resolve at compile time.
+*/
+
+template <typename SampleT, typename M>
+inline M RingKey(const SampleT* slot, M SampleT::* member) {
+	return slot->*member;
+}
+
+template <typename SampleT, typename R>
+inline R RingKey(const SampleT* slot, R (*accessor)(const SampleT*)) {
+	return accessor(slot);
+}
+
+
+template <uint8_t N, typename SampleT>
+class HourlyRing {
+	static_assert(N >= 1 && N <= 127, "HourlyRing needs 1 to 127 slots");
+
+public:
+	static const uint8_t	Size = N;
+
+	class Iterator {
+	public:
+		Iterator(const SampleT* slot, const SampleT* end) : slot(slot), end(end) { skipEmpty(); }
+		const SampleT&	operator*() const { return *slot; }
+		const SampleT*	operator->() const { return slot; }
+		Iterator&		operator++() { slot++; skipEmpty(); return *this; }
+		bool			operator!=(const Iterator& other) const { return slot != other.slot; }
+
+	private:
+		const SampleT*	slot;
+		const SampleT*	end;
+
+		void skipEmpty() {
+			while (slot != end && IsEmptySlot(slot)) {
+				slot++;
+			}
+		}
+	};
+
+	static uint8_t slotFor(uint32_t epochHour) {
+		return ((N & (N - 1)) == 0) ? (uint8_t)(epochHour & (N - 1)) : (uint8_t)(epochHour % N);
+	}
+
+	void clear() {
+		for (uint8_t i = 0; i < N; i++) {
+			ClearSlot(&slots[i]);
+		}
+	}
+
+	SampleT&		operator[](uint8_t index) { return slots[index]; }
+	const SampleT&	operator[](uint8_t index) const { return slots[index]; }
+	SampleT*		data() { return slots; }
+
+	Iterator begin() const { return Iterator(slots, slots + N); }
+	Iterator end() const { return Iterator(slots + N, slots + N); }
+
+	// The first slot with the lowest key, NULL if all are empty
+	template <typename Key>
+	const SampleT* minBy(Key key) const {
+		const SampleT*	best = NULL;
+
+		for (const SampleT* slot = slots; slot != slots + N; slot++) {
+			if (!IsEmptySlot(slot) && (best == NULL || RingKey(slot, key) < RingKey(best, key))) {
+				best = slot;
+			}
+		}
+		return best;
+	}
+
+	// The first slot with the highest key, NULL if all are empty
+	template <typename Key>
+	const SampleT* maxBy(Key key) const {
+		const SampleT*	best = NULL;
+
+		for (const SampleT* slot = slots; slot != slots + N; slot++) {
+			if (!IsEmptySlot(slot) && (best == NULL || RingKey(slot, key) > RingKey(best, key))) {
+				best = slot;
+			}
+		}
+		return best;
+	}
+
+	// total = step(total, slot) over the non-empty slots
+	template <typename T, typename Step>
+	T fold(T total, Step step) const {
+		for (const SampleT* slot = slots; slot != slots + N; slot++) {
+			if (!IsEmptySlot(slot)) {
+				total = step(total, slot);
+			}
+		}
+		return total;
+	}
+
+protected:
+	SampleT			slots[N];
+};
+
+#endif
@@ -53,6 +53,64 @@ void formatFloat(float voltage, char* buffer, uint8_t width, uint8_t precis) {
 }
 
 
+// Same output as formatFloat(millivolts / 1000.0, ...), without the float math.
+// precis is at most 3.
+void formatMillivolts(uint16_t millivolts, char* buffer, uint8_t width, uint8_t precis) {
+	uint16_t divisor = 1;
+	uint16_t unit = 1;
+	uint16_t scaled;
+	char     digits[12];
+	uint8_t  i;
+
+	if (precis > 3) {
+		precis = 3;
+	}
+	for (i = precis; i < 3; i++) {
+		divisor *= 10;
+	}
+	for (i = 0; i < precis; i++) {
+		unit *= 10;
+	}
+	scaled = (millivolts + (uint32_t)divisor / 2) / divisor;
+
+	if (precis == 0) {
+		sprintf_P(digits, PSTR("%u"), scaled);
+	}
+	else {
+		sprintf_P(digits, PSTR("%u.%0*u"), scaled / unit, precis, scaled % unit);
+	}
+
+	if (strlen(digits) > width) {
+		memset(buffer, '*', width);
+		buffer[width] = 0;
+	}
+	else {
+		sprintf_P(buffer, PSTR("%*s"), width, digits);
+	}
+}
+
+
+// A temperature in 0.25 degree C steps (as the DS3231 and the hourly data keep
+// it) to one decimal of Celsius or Fahrenheit.  This is the only place it
+// leaves that form.
+void formatQuarterDegrees(int16_t quarterDegrees, char* buffer, uint8_t width, bool fahrenheit) {
+	int32_t  doubleTenths = fahrenheit ? (int32_t)quarterDegrees * 9 + 640 : (int32_t)quarterDegrees * 5;
+	int16_t  tenths = (doubleTenths < 0) ? (doubleTenths - 1) / 2 : (doubleTenths + 1) / 2;
+	uint16_t magnitude = (tenths < 0) ? -tenths : tenths;
+	char     digits[12];
+
+	sprintf_P(digits, PSTR("%s%u.%u"), (tenths < 0) ? "-" : "", magnitude / 10, magnitude % 10);
+
+	if (strlen(digits) > width) {
+		memset(buffer, '*', width);
+		buffer[width] = 0;
+	}
+	else {
+		sprintf_P(buffer, PSTR("%*s"), width, digits);
+	}
+}
+
+
 void lcdPrint(LiquidCrystal lcd, char* text, int padLength) {
 	int textLength = strlen(text);
 	int neededPadding;
@@ -83,6 +141,16 @@ void lcdPrint(LiquidCrystal lcd, char* text, int padLength) {
 }
 
 
+// Fixed text kept in flash (F("...")), so it costs no SRAM until printed
+void lcdPrint(LiquidCrystal lcd, const __FlashStringHelper* text, int padLength) {
+	char buffer[21];
+
+	strncpy_P(buffer, (const char*)text, 20);
+	buffer[20] = 0;
+	lcdPrint(lcd, buffer, padLength);
+}
+
+
 void CreateArrows(LiquidCrystal lcd) {
 	byte downArrow[8] = {
 		0b00100,
@@ -38,6 +38,11 @@ void CreateArrows(LiquidCrystal lcd);
 
 void formatFloat(float voltage, char *buffer, uint8_t width, uint8_t precis);
 
+void formatMillivolts(uint16_t millivolts, char *buffer, uint8_t width, uint8_t precis);
+
+void formatQuarterDegrees(int16_t quarterDegrees, char *buffer, uint8_t width, bool fahrenheit);
+
 void lcdPrint(LiquidCrystal lcd, char *text, int padLength);
+void lcdPrint(LiquidCrystal lcd, const __FlashStringHelper *text, int padLength);
 
 #endif
@@ -0,0 +1,132 @@
+/**
+ *  My Extension to some open source application
+ *
+ *  Copyright 2022 by Edward Figarsky <efigarsky@gmail.com>
+ *
+ * This file is part of an open source application.
+ *
+ * Some open source application is free software: you can redistribute
+ * it and/or modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * Some open source application is distributed in the hope that it will
+ * be useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * @license GPL-3.0+ <http://spdx.org/licenses/GPL-3.0+>
+ */
+#include <avr/pgmspace.h>
+#include "StateOfCharge.h"
+
+struct ocvPointStruct {
+	uint16_t	millivolts;
+	uint8_t		percent;
+};
+typedef struct ocvPointStruct OcvPoint;
+
+// Rested 12 V flooded lead-acid at 25 C, lowest voltage first
+static const OcvPoint ocvTable[] PROGMEM = {
+	{ 11310,   0 },
+	{ 11510,  10 },
+	{ 11660,  20 },
+	{ 11810,  30 },
+	{ 11960,  40 },
+	{ 12100,  50 },
+	{ 12240,  60 },
+	{ 12370,  70 },
+	{ 12500,  80 },
+	{ 12620,  90 },
+	{ 12730, 100 }
+};
+#define OCV_POINTS	(sizeof(ocvTable) / sizeof(ocvTable[0]))
+
+
+void InitStateOfCharge(StateOfCharge* soc) {
+	soc->restAnchor = 0;
+	soc->restStart = 0;
+	soc->isResting = false;
+	soc->percentEma = 0;
+	soc->percent = SOC_UNKNOWN;
+	soc->lastHourAverage = 0;
+	soc->dropPerHour = 0;
+	soc->minutesToCutoff = SOC_NO_CUTOFF;
+}
+
+
+uint8_t OpenCircuitPercent(uint16_t millivolts, int16_t quarterDegrees) {
+	int32_t		corrected = millivolts + (int32_t)(100 - quarterDegrees) * SOC_TEMP_UV_PER_DEGREE / 4000;
+	uint16_t	lowVolts = pgm_read_word(&ocvTable[0].millivolts);
+	uint8_t		lowPercent = pgm_read_byte(&ocvTable[0].percent);
+	uint16_t	highVolts;
+	uint8_t		highPercent;
+
+	if (corrected <= lowVolts) {
+		return lowPercent;
+	}
+	for (uint8_t i = 1; i < OCV_POINTS; i++) {
+		highVolts = pgm_read_word(&ocvTable[i].millivolts);
+		highPercent = pgm_read_byte(&ocvTable[i].percent);
+		if (corrected < highVolts) {
+			return lowPercent + (corrected - lowVolts) * (highPercent - lowPercent) / (highVolts - lowVolts);
+		}
+		lowVolts = highVolts;
+		lowPercent = highPercent;
+	}
+	return lowPercent;
+}
+
+
+// 'millivolts' is the filtered battery voltage, 'loaded' whether the output
+// relay is closed
+void UpdateStateOfCharge(StateOfCharge* soc, uint16_t millivolts, int16_t quarterDegrees, bool loaded, uint16_t cutoffMillivolts, uint32_t now) {
+	uint8_t		estimate;
+
+	// Rest detection: any load, or a move outside the band, starts it over
+	if (loaded) {
+		soc->restStart = 0;
+		soc->isResting = false;
+	}
+	else if (soc->restStart == 0 || millivolts > soc->restAnchor + SOC_REST_BAND || millivolts + SOC_REST_BAND < soc->restAnchor) {
+		soc->restAnchor = millivolts;
+		soc->restStart = now;
+		soc->isResting = false;
+	}
+	else if (now - soc->restStart >= SOC_REST_SECONDS) {
+		soc->isResting = true;
+	}
+
+	estimate = OpenCircuitPercent(millivolts + (loaded ? SOC_LOAD_SAG : 0), quarterDegrees);
+	if (soc->isResting || soc->percent == SOC_UNKNOWN) {
+		soc->percentEma = (uint16_t)estimate << 8;
+	}
+	else {
+		soc->percentEma -= soc->percentEma >> SOC_LOADED_SHIFT;
+		soc->percentEma += ((uint16_t)estimate << 8) >> SOC_LOADED_SHIFT;
+	}
+	soc->percent = (soc->percentEma + 0x80) >> 8;
+
+	if (soc->dropPerHour > 0 && millivolts > cutoffMillivolts) {
+		uint32_t minutes = (uint32_t)(millivolts - cutoffMillivolts) * 60 / soc->dropPerHour;
+		soc->minutesToCutoff = (minutes >= SOC_NO_CUTOFF) ? SOC_NO_CUTOFF - 1 : minutes;
+	}
+	else {
+		soc->minutesToCutoff = (millivolts <= cutoffMillivolts) ? 0 : SOC_NO_CUTOFF;
+	}
+}
+
+
+// Feeds the rate of fall from one hourly average to the next
+void StateOfChargeHourClosed(StateOfCharge* soc, uint16_t averageMillivolts) {
+	int16_t		drop;
+
+	if (soc->lastHourAverage != 0) {
+		drop = (int16_t)soc->lastHourAverage - (int16_t)averageMillivolts;
+		soc->dropPerHour += (drop - soc->dropPerHour) / 2;
+	}
+	soc->lastHourAverage = averageMillivolts;
+}
@@ -0,0 +1,69 @@
+/**
+ *  My Extension to some open source application
+ *
+ *  Copyright 2022 by Edward Figarsky <efigarsky@gmail.com>
+ *
+ * This file is part of an open source application.
+ *
+ * Some open source application is free software: you can redistribute
+ * it and/or modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * Some open source application is distributed in the hope that it will
+ * be useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * @license GPL-3.0+ <http://spdx.org/licenses/GPL-3.0+>
+ */
+#pragma once
+#ifndef _StateOfCharge_h_
+#define _StateOfCharge_h_
+
+#include "Arduino.h"
+
+/*
+  State of charge and time to cutoff, from the battery voltage alone.
+
+  A lead-acid battery's open-circuit voltage tracks its charge, but only once
+  it has rested: relay open, and the voltage within SOC_REST_BAND of where it
+  settled for SOC_REST_SECONDS.  Each reading is corrected to 25 C and looked
+  up in a piecewise-linear table in flash.  At rest the lookup is taken as
+  is; otherwise SOC_LOAD_SAG is added back while loaded and the lookup only
+  nudges the estimate (an EMA), since it is a rougher guess.
+
+  Time to cutoff is the gap to the disable threshold over how fast the hourly
+  average is falling, smoothed across hours.  Every sample and every closed
+  hour costs a few integer operations; no history is rescanned.
+*/
+
+#define SOC_REST_SECONDS		1800	// relay open and steady this long is "at rest"
+#define SOC_REST_BAND			20		// mV the voltage may wander while resting
+#define SOC_LOAD_SAG			150		// mV the load is assumed to pull the battery down
+#define SOC_TEMP_UV_PER_DEGREE	1200	// OCV temperature coefficient of a 12 V battery, microvolts per C
+#define SOC_LOADED_SHIFT		3		// EMA alpha 1/8 for estimates not taken at rest
+#define SOC_UNKNOWN				0xFF	// percent before the first sample
+#define SOC_NO_CUTOFF			0xFFFF	// minutesToCutoff while the voltage isn't falling
+
+struct stateOfChargeStruct {
+	uint16_t	restAnchor;				// mV where the current steady spell began
+	uint32_t	restStart;				// Epoch seconds it began, 0 while loaded
+	bool		isResting;
+	uint16_t	percentEma;				// Estimate, 1/256 percent steps
+	uint8_t		percent;				// Estimate, 0-100 or SOC_UNKNOWN
+	uint16_t	lastHourAverage;		// mV average of the last closed hour, 0 if none yet
+	int16_t		dropPerHour;			// mV per hour the average is falling, smoothed
+	uint16_t	minutesToCutoff;		// At that rate, or SOC_NO_CUTOFF
+};
+typedef struct stateOfChargeStruct StateOfCharge;
+
+void InitStateOfCharge(StateOfCharge* soc);
+void UpdateStateOfCharge(StateOfCharge* soc, uint16_t millivolts, int16_t quarterDegrees, bool loaded, uint16_t cutoffMillivolts, uint32_t now);
+void StateOfChargeHourClosed(StateOfCharge* soc, uint16_t averageMillivolts);
+uint8_t OpenCircuitPercent(uint16_t millivolts, int16_t quarterDegrees);
+
+#endif
@@ -0,0 +1,71 @@
+/**
+ *  My Extension to some open source application
+ *
+ *  Copyright 2022 by Edward Figarsky <efigarsky@gmail.com>
+ *
+ * This file is part of an open source application.
+ *
+ * Some open source application is free software: you can redistribute
+ * it and/or modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * Some open source application is distributed in the hope that it will
+ * be useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * @license GPL-3.0+ <http://spdx.org/licenses/GPL-3.0+>
+ */
+#include <avr/pgmspace.h>
+#include "TempCompensation.h"
+
+// Millivolts added to both thresholds, 0 at 25 C and about 12 mV per degree
+// (2 mV per cell) either side of it, taken at the middle of each bucket.
+static const int16_t thresholdOffsets[TEMP_COMP_BUCKETS] PROGMEM = {
+	-510,	// below -15 C
+	-450,	// -15 to -10
+	-390,	// -10 to -5
+	-330,	//  -5 to  0
+	-270,	//   0 to  5
+	-210,	//   5 to 10
+	-150,	//  10 to 15
+	 -90,	//  15 to 20
+	 -30,	//  20 to 25
+	  30,	//  25 to 30
+	  90,	//  30 to 35
+	 150,	//  35 to 40
+	 210,	//  40 to 45
+	 270	//  45 and up
+};
+
+
+uint8_t TemperatureBucket(int16_t quarterDegrees, uint8_t currentBucket) {
+	int16_t	bottom;
+	int16_t	bucket;
+
+	if (currentBucket < TEMP_COMP_BUCKETS) {
+		bottom = TEMP_COMP_FIRST + (currentBucket - 1) * TEMP_COMP_BUCKET_WIDTH;
+		if ((currentBucket == 0 || quarterDegrees >= bottom - TEMP_COMP_HYSTERESIS) &&
+			(currentBucket == TEMP_COMP_BUCKETS - 1 || quarterDegrees < bottom + TEMP_COMP_BUCKET_WIDTH + TEMP_COMP_HYSTERESIS)) {
+			return currentBucket;
+		}
+	}
+
+	if (quarterDegrees < TEMP_COMP_FIRST) {
+		return 0;
+	}
+	bucket = (quarterDegrees - TEMP_COMP_FIRST) / TEMP_COMP_BUCKET_WIDTH + 1;
+	return (bucket >= TEMP_COMP_BUCKETS) ? TEMP_COMP_BUCKETS - 1 : bucket;
+}
+
+
+int16_t ThresholdOffset(uint8_t bucket) {
+	if (bucket >= TEMP_COMP_BUCKETS) {
+		return 0;
+	}
+	return (int16_t)pgm_read_word(&thresholdOffsets[bucket]);
+}
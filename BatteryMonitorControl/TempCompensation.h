@@ -0,0 +1,50 @@
+/**
+ *  My Extension to some open source application
+ *
+ *  Copyright 2022 by Edward Figarsky <efigarsky@gmail.com>
+ *
+ * This file is part of an open source application.
+ *
+ * Some open source application is free software: you can redistribute
+ * it and/or modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * Some open source application is distributed in the hope that it will
+ * be useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * @license GPL-3.0+ <http://spdx.org/licenses/GPL-3.0+>
+ */
+#pragma once
+#ifndef _TempCompensation_h_
+#define _TempCompensation_h_
+
+#include "Arduino.h"
+
+/*
+  Temperature compensation of the disable/enable thresholds.
+
+  A lead-acid battery's voltage at a given state of charge falls as it gets
+  colder, so fixed thresholds disconnect a cold battery that is really fine.
+  The table in flash holds a millivolt offset for each 5 C bucket of the
+  DS3231 temperature, and the thresholds are recomputed (in raw counts, see
+  SetVoltageThresholds()) only when the bucket changes.  A bucket is kept
+  until the temperature is TEMP_COMP_HYSTERESIS past its edge, so a reading
+  sitting on a boundary doesn't flip it back and forth.
+*/
+
+#define TEMP_COMP_BUCKETS			14
+#define TEMP_COMP_FIRST				(-15 * 4)	// bottom of bucket 1 (bucket 0 is anything colder), 0.25 C steps
+#define TEMP_COMP_BUCKET_WIDTH		(5 * 4)		// 0.25 C steps
+#define TEMP_COMP_HYSTERESIS		4			// 0.25 C steps
+#define TEMP_COMP_NONE				0xFF		// no bucket chosen yet
+
+uint8_t TemperatureBucket(int16_t quarterDegrees, uint8_t currentBucket);
+int16_t ThresholdOffset(uint8_t bucket);
+
+#endif
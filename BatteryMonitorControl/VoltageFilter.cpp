@@ -0,0 +1,78 @@
+/**
+ *  My Extension to some open source application
+ *
+ *  Copyright 2022 by Edward Figarsky <efigarsky@gmail.com>
+ *
+ * This file is part of an open source application.
+ *
+ * Some open source application is free software: you can redistribute
+ * it and/or modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * Some open source application is distributed in the hope that it will
+ * be useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * @license GPL-3.0+ <http://spdx.org/licenses/GPL-3.0+>
+ */
+#include "VoltageFilter.h"
+
+
+void InitVoltageFilter(VoltageFilter* filter, uint8_t shift) {
+	filter->next = 0;
+	filter->primed = 0;
+	filter->shift = (shift > VOLTAGE_FILTER_SHIFT_MAX) ? VOLTAGE_FILTER_SHIFT_MAX : shift;
+	filter->ema = 0;
+}
+
+
+static uint16_t MedianOfTaps(const VoltageFilter* filter) {
+	uint16_t	sorted[VOLTAGE_FILTER_TAPS];
+	uint16_t	value;
+	int8_t		j;
+
+	// Insertion sort, five values is nothing
+	for (uint8_t i = 0; i < VOLTAGE_FILTER_TAPS; i++) {
+		value = filter->taps[i];
+		for (j = i - 1; j >= 0 && sorted[j] > value; j--) {
+			sorted[j + 1] = sorted[j];
+		}
+		sorted[j + 1] = value;
+	}
+	return sorted[VOLTAGE_FILTER_TAPS / 2];
+}
+
+
+// Adds a raw reading and returns the filtered value, in the same raw units
+uint16_t FilterVoltage(VoltageFilter* filter, uint16_t raw) {
+	if (!filter->primed) {
+		for (uint8_t i = 0; i < VOLTAGE_FILTER_TAPS; i++) {
+			filter->taps[i] = raw;
+		}
+		filter->ema = (uint32_t)raw << filter->shift;
+		filter->primed = 1;
+		return raw;
+	}
+
+	filter->taps[filter->next] = raw;
+	if (++filter->next >= VOLTAGE_FILTER_TAPS) {
+		filter->next = 0;
+	}
+
+	filter->ema -= filter->ema >> filter->shift;
+	filter->ema += MedianOfTaps(filter);
+	return FilteredVoltage(filter);
+}
+
+
+uint16_t FilteredVoltage(const VoltageFilter* filter) {
+	if (filter->shift == 0) {
+		return filter->ema;
+	}
+	return (filter->ema + (1UL << (filter->shift - 1))) >> filter->shift;
+}
@@ -0,0 +1,55 @@
+/**
+ *  My Extension to some open source application
+ *
+ *  Copyright 2022 by Edward Figarsky <efigarsky@gmail.com>
+ *
+ * This file is part of an open source application.
+ *
+ * Some open source application is free software: you can redistribute
+ * it and/or modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * Some open source application is distributed in the hope that it will
+ * be useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * @license GPL-3.0+ <http://spdx.org/licenses/GPL-3.0+>
+ */
+#pragma once
+#ifndef _VoltageFilter_h_
+#define _VoltageFilter_h_
+
+#include "Arduino.h"
+
+/*
+  Streaming filter between the voltage readings and the power decision.
+
+  A 5-tap median drops single wild readings (a load surge, a noisy wake)
+  outright, and an exponential moving average with alpha = 1 / 2^shift
+  smooths what is left.  The state is a few bytes and each reading costs a
+  handful of compares and a shift, no floats.  The first reading primes both
+  stages, so the output starts at the real voltage rather than climbing from 0.
+*/
+
+#define VOLTAGE_FILTER_TAPS			5
+#define VOLTAGE_FILTER_SHIFT_MAX	8
+
+struct voltageFilterStruct {
+	uint16_t	taps[VOLTAGE_FILTER_TAPS];	// The last raw readings
+	uint8_t		next;						// Tap the next reading goes in
+	uint8_t		primed;						// Nonzero once a reading has been taken
+	uint8_t		shift;						// EMA alpha is 1 / 2^shift
+	uint32_t	ema;						// EMA of the medians, scaled by 2^shift
+};
+typedef struct voltageFilterStruct VoltageFilter;
+
+void InitVoltageFilter(VoltageFilter* filter, uint8_t shift);
+uint16_t FilterVoltage(VoltageFilter* filter, uint16_t raw);
+uint16_t FilteredVoltage(const VoltageFilter* filter);
+
+#endif
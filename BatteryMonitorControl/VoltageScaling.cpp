@@ -0,0 +1,71 @@
+/**
+ *  My Extension to some open source application
+ *
+ *  Copyright 2022 by Edward Figarsky <efigarsky@gmail.com>
+ *
+ * This file is part of an open source application.
+ *
+ * Some open source application is free software: you can redistribute
+ * it and/or modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * Some open source application is distributed in the hope that it will
+ * be useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * @license GPL-3.0+ <http://spdx.org/licenses/GPL-3.0+>
+ */
+#include "VoltageScaling.h"
+
+
+static void UpdateRawThresholds(VoltageScale* scale) {
+	scale->disableRaw = MillivoltsToRaw(scale, scale->disableMillivolts);
+	scale->enableRaw = MillivoltsToRaw(scale, scale->enableMillivolts);
+}
+
+
+void SetVoltageScale(VoltageScale* scale, float voltsPerCount) {
+	scale->millivoltsPerCount = voltsPerCount * 1000.0 * 65536.0 + 0.5;
+	UpdateRawThresholds(scale);
+}
+
+
+void SetVoltageThresholds(VoltageScale* scale, uint16_t disableMillivolts, uint16_t enableMillivolts) {
+	scale->disableMillivolts = disableMillivolts;
+	scale->enableMillivolts = enableMillivolts;
+	UpdateRawThresholds(scale);
+}
+
+
+uint16_t RawToMillivolts(const VoltageScale* scale, uint16_t raw) {
+	uint32_t millivolts = (raw * scale->millivoltsPerCount + 0x8000) >> 16;
+
+	return (millivolts > 0xFFFF) ? 0xFFFF : millivolts;
+}
+
+
+// The smallest raw reading that converts to at least 'millivolts', so that
+// raw < MillivoltsToRaw(mv) gives exactly the same answer as
+// RawToMillivolts(raw) < mv.  The division only gets close; rounding in
+// RawToMillivolts() is settled by stepping.
+uint16_t MillivoltsToRaw(const VoltageScale* scale, uint16_t millivolts) {
+	uint32_t raw;
+
+	if (scale->millivoltsPerCount == 0)
+		return 0xFFFF;
+
+	raw = ((uint32_t)millivolts << 16) / scale->millivoltsPerCount;
+	if (raw > 0xFFFF)
+		return 0xFFFF;
+
+	while (raw > 0 && RawToMillivolts(scale, raw - 1) >= millivolts)
+		raw--;
+	while (raw < 0xFFFF && RawToMillivolts(scale, raw) < millivolts)
+		raw++;
+	return raw;
+}
@@ -0,0 +1,59 @@
+/**
+ *  My Extension to some open source application
+ *
+ *  Copyright 2022 by Edward Figarsky <efigarsky@gmail.com>
+ *
+ * This file is part of an open source application.
+ *
+ * Some open source application is free software: you can redistribute
+ * it and/or modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * Some open source application is distributed in the hope that it will
+ * be useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * @license GPL-3.0+ <http://spdx.org/licenses/GPL-3.0+>
+ */
+#pragma once
+#ifndef _VoltageScaling_h_
+#define _VoltageScaling_h_
+
+#include "Arduino.h"
+
+#define VOLTAGE_EXTRA_BITS		2		// oversampled battery voltage: 12 bits from 16 samples
+#define VOLTAGE_FULL_SCALE		(1024UL << VOLTAGE_EXTRA_BITS)
+
+/*
+  Integer battery voltage pipeline.
+
+  The calibration (volts per raw ADC count) is turned into a Q16.16 millivolts
+  per count multiplier once, when it is set or changes.  The disable/enable
+  thresholds are kept in raw counts next to it, so the per-sample control
+  decision is an integer compare and a sample only needs one 32 bit multiply
+  to become millivolts.  Floats are left to setup and display.
+
+  raw * millivoltsPerCount must fit 32 bits, i.e. full scale below 65.5 V.
+  Raw counts are 10 + VOLTAGE_EXTRA_BITS bits, VOLTAGE_FULL_SCALE of them.
+*/
+
+struct voltageScaleStruct {
+	uint32_t	millivoltsPerCount;		// Q16.16
+	uint16_t	disableMillivolts;		// Power is disabled below this
+	uint16_t	enableMillivolts;		// Power is (re-)enabled at or above this
+	uint16_t	disableRaw;				// disableMillivolts in raw counts
+	uint16_t	enableRaw;				// enableMillivolts in raw counts
+};
+typedef struct voltageScaleStruct VoltageScale;
+
+void SetVoltageScale(VoltageScale* scale, float voltsPerCount);
+void SetVoltageThresholds(VoltageScale* scale, uint16_t disableMillivolts, uint16_t enableMillivolts);
+uint16_t RawToMillivolts(const VoltageScale* scale, uint16_t raw);
+uint16_t MillivoltsToRaw(const VoltageScale* scale, uint16_t millivolts);
+
+#endif
@@ -0,0 +1,559 @@
+/**
+ *  My Extension to some open source application
+ *
+ *  Copyright 2022 by Edward Figarsky <efigarsky@gmail.com>
+ *
+ * This file is part of an open source application.
+ *
+ * Some open source application is free software: you can redistribute
+ * it and/or modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * Some open source application is distributed in the hope that it will
+ * be useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * @license GPL-3.0+ <http://spdx.org/licenses/GPL-3.0+>
+ */
+#include "adc_sampler.h"
+
+#ifdef __AVR__
+ #include <avr/interrupt.h>
+ #include <avr/sleep.h>
+#endif
+
+#if defined(CONFIG_ADC_SAMPLER) && !defined(__AVR__)
+ #undef CONFIG_ADC_SAMPLER
+#endif
+
+#define ADC_SAMPLER_RATE_MAX	9000		// a conversion takes 13 ADC clocks at 125 kHz
+
+
+static uint8_t				adcReference = DEFAULT << 6;	// REFS1:0 for ADMUX
+static uint8_t				adcChannels[ADC_SAMPLER_CHANNELS_MAX];
+static uint8_t				adcChannelCount = 0;
+static volatile uint8_t		adcCurrent;						// index of the channel being converted
+static volatile uint16_t	adcRemaining;					// conversions still to go
+static volatile uint8_t		adcStatus = ADC_SAMPLER_OK;
+static volatile uint32_t	adcSums[ADC_SAMPLER_CHANNELS_MAX];
+static volatile uint16_t	adcCounts[ADC_SAMPLER_CHANNELS_MAX];
+static volatile uint16_t	adcRing[ADC_SAMPLER_BUFFER];
+static volatile uint8_t		adcRingHead;					// next slot to fill
+static volatile uint8_t		adcRingFill;
+static uint16_t				adcLfsr = 0xACE1;
+
+
+// 'reference' is what was given to analogReference(): DEFAULT, EXTERNAL or INTERNAL
+void adc_sampler_begin(const uint8_t reference)
+{
+    adcReference = reference << 6;
+}
+
+
+static uint8_t adc_sampler_channel(uint8_t pin)
+{
+    if (pin >= A0)
+        pin -= A0;
+    return pin & 0x07;
+}
+
+
+// 16-bit Galois LFSR, plenty to decorrelate sample times
+static uint16_t adc_sampler_random(void)
+{
+    adcLfsr = (adcLfsr >> 1) ^ (-(adcLfsr & 1) & 0xB400);
+    return adcLfsr;
+}
+
+
+// Dither range for a sample period: the largest 2^k - 1 up to a quarter of it
+static uint16_t adc_sampler_jitter_mask(const uint32_t period)
+{
+    uint16_t mask = 0;
+
+    while (mask < 0x7FFF && (uint32_t)((mask << 1) | 1) <= period / 4)
+        mask = (mask << 1) | 1;
+    return mask;
+}
+
+
+static void adc_sampler_store(const uint16_t value)
+{
+    uint8_t channel = adcCurrent;
+
+    adcSums[channel] += value;
+    adcCounts[channel]++;
+    adcRing[adcRingHead] = value;
+    adcRingHead = (adcRingHead + 1) & (ADC_SAMPLER_BUFFER - 1);
+    if (adcRingFill < ADC_SAMPLER_BUFFER)
+        adcRingFill++;
+}
+
+
+static uint8_t adc_sampler_prepare(const uint8_t *pins, const uint8_t pinCount, const uint16_t samples, const uint16_t rateHz)
+{
+    uint8_t i;
+
+    if (adcStatus == ADC_SAMPLER_BUSY)
+        return ADC_SAMPLER_BUSY;
+    if (pinCount == 0 || pinCount > ADC_SAMPLER_CHANNELS_MAX || samples == 0 || rateHz == 0 || rateHz > ADC_SAMPLER_RATE_MAX)
+        return ADC_SAMPLER_BAD_REQUEST;
+
+    for (i = 0; i < pinCount; i++) {
+        adcChannels[i] = adc_sampler_channel(pins[i]);
+        adcSums[i] = 0;
+        adcCounts[i] = 0;
+    }
+    adcChannelCount = pinCount;
+    adcCurrent = 0;
+    adcRemaining = samples * pinCount;
+    adcRingHead = 0;
+    adcRingFill = 0;
+    return ADC_SAMPLER_OK;
+}
+
+
+uint8_t adc_sampler_busy(void)
+{
+    return adcStatus == ADC_SAMPLER_BUSY;
+}
+
+
+uint32_t adc_sampler_sum(const uint8_t channel)
+{
+    uint32_t sum;
+
+    noInterrupts();
+    sum = adcSums[channel];
+    interrupts();
+    return sum;
+}
+
+
+uint16_t adc_sampler_count(const uint8_t channel)
+{
+    uint16_t count;
+
+    noInterrupts();
+    count = adcCounts[channel];
+    interrupts();
+    return count;
+}
+
+
+// Copies up to n of the most recent raw samples, oldest first, all channels
+// interleaved in the order they were taken.  Returns how many were copied.
+uint8_t adc_sampler_recent(uint16_t *buf, uint8_t n)
+{
+    uint8_t i;
+    uint8_t from;
+
+    noInterrupts();
+    if (n > adcRingFill)
+        n = adcRingFill;
+    from = (adcRingHead - n) & (ADC_SAMPLER_BUFFER - 1);
+    for (i = 0; i < n; i++)
+        buf[i] = adcRing[(from + i) & (ADC_SAMPLER_BUFFER - 1)];
+    interrupts();
+    return n;
+}
+
+
+// Switches the ADC off for power-down sleep, where it would keep drawing
+// current, after letting a running batch finish.  Returns what ADCSRA was,
+// for adc_sampler_resume().
+uint8_t adc_sampler_suspend(void)
+{
+    uint8_t adcsra;
+
+    adc_sampler_wait();
+    adcsra = ADCSRA;
+    ADCSRA = 0;
+    return adcsra;
+}
+
+
+void adc_sampler_resume(const uint8_t adcsra)
+{
+    ADCSRA = adcsra;
+}
+
+
+#ifdef CONFIG_ADC_SAMPLER
+
+/*==========================+
+|	Interrupt-driven engine	|
++==========================*/
+
+static uint32_t			adcStartMillis;
+static uint32_t			adcTimeoutMillis;
+static volatile uint8_t	adcQuiet = 0;		// the ADC interrupt only has to store the sample
+static uint16_t			adcTicks;			// Timer1 ticks per sample period
+static uint16_t			adcJitterMask;		// 0 unless dithering
+
+// Timer1 and ADC setup from before the batch
+static uint8_t	savedTCCR1A;
+static uint8_t	savedTCCR1B;
+static uint16_t	savedOCR1A;
+static uint16_t	savedOCR1B;
+static uint8_t	savedTIMSK1;
+static uint8_t	savedADCSRA;
+static uint8_t	savedADCSRB;
+static uint8_t	savedADMUX;
+
+
+static void adc_sampler_idle(void)
+{
+    set_sleep_mode(SLEEP_MODE_IDLE);
+    sleep_enable();
+    sleep_cpu();
+    sleep_disable();
+}
+
+
+// Entering SLEEP_MODE_ADC with the ADC enabled starts a conversion, and its
+// interrupt wakes us again.  Anything else that wakes us early (only async
+// sources run in this mode) just sends us back to sleep; a conversion already
+// running is not restarted.
+static uint8_t adc_sampler_run_quiet(const uint16_t rateHz, const uint8_t mode)
+{
+    uint32_t periodMicros = 1000000UL / rateHz;
+    uint16_t jitterMask = (mode & ADC_SAMPLER_DITHER) ? adc_sampler_jitter_mask(periodMicros) : 0;
+    uint32_t waitMicros;
+    uint32_t lastMicros = micros();
+    uint32_t elapsed;
+    uint16_t left;
+    uint8_t savedADCSRA = ADCSRA;
+    uint8_t savedADMUX = ADMUX;
+
+    adcQuiet = 1;
+    adcStatus = ADC_SAMPLER_BUSY;
+    ADCSRA = _BV(ADEN) | _BV(ADIE) | _BV(ADIF) | _BV(ADPS2) | _BV(ADPS1) | _BV(ADPS0);
+
+    while (adcRemaining > 0) {
+        // Wait out the sample period; Timer 0 ticks wake us every millisecond
+        waitMicros = periodMicros + (adc_sampler_random() & jitterMask);
+        while ((elapsed = micros() - lastMicros) < waitMicros) {
+            if (waitMicros - elapsed > 1100)
+                adc_sampler_idle();
+            else
+                delayMicroseconds(waitMicros - elapsed);
+        }
+
+        ADMUX = adcReference | adcChannels[adcCurrent];
+        left = adcRemaining;
+        lastMicros = micros();
+        for (;;) {
+            cli();
+            if (adcRemaining != left) {
+                sei();
+                break;
+            }
+            set_sleep_mode(SLEEP_MODE_ADC);
+            sleep_enable();
+            sei();
+            sleep_cpu();
+            sleep_disable();
+        }
+
+        if (++adcCurrent >= adcChannelCount)
+            adcCurrent = 0;
+    }
+
+    ADCSRA = savedADCSRA & ~_BV(ADIF);
+    ADMUX = savedADMUX;
+    adcQuiet = 0;
+    adcStatus = ADC_SAMPLER_OK;
+    return ADC_SAMPLER_OK;
+}
+
+
+uint8_t adc_sampler_start(const uint8_t *pins, const uint8_t pinCount, const uint16_t samples, const uint16_t rateHz, const uint8_t mode)
+{
+    uint32_t ticks;
+    uint8_t clockSelect;
+    uint8_t status;
+
+    status = adc_sampler_prepare(pins, pinCount, samples, rateHz);
+    if (status != ADC_SAMPLER_OK)
+        return status;
+    if (mode & ADC_SAMPLER_QUIET)
+        return adc_sampler_run_quiet(rateHz, mode);
+
+    // clk/64 covers 4 Hz and up, clk/1024 anything slower
+    ticks = F_CPU / 64 / rateHz;
+    clockSelect = _BV(CS11) | _BV(CS10);
+    if (ticks > 65536) {
+        ticks = F_CPU / 1024 / rateHz;
+        clockSelect = _BV(CS12) | _BV(CS10);
+        if (ticks > 65536)
+            ticks = 65536;
+    }
+    adcJitterMask = (mode & ADC_SAMPLER_DITHER) ? adc_sampler_jitter_mask(ticks) : 0;
+    if (ticks + adcJitterMask > 65536)
+        ticks = 65536 - adcJitterMask;
+    adcTicks = ticks;
+
+    adcStartMillis = millis();
+    adcTimeoutMillis = (uint32_t)adcRemaining * 2000 / rateHz + 10;
+    adcStatus = ADC_SAMPLER_BUSY;
+
+    cli();
+    savedTCCR1A = TCCR1A;
+    savedTCCR1B = TCCR1B;
+    savedOCR1A = OCR1A;
+    savedOCR1B = OCR1B;
+    savedTIMSK1 = TIMSK1;
+    savedADCSRA = ADCSRA;
+    savedADCSRB = ADCSRB;
+    savedADMUX = ADMUX;
+
+    // Timer1 in CTC mode (TOP = OCR1A), pins disconnected, no interrupts of its own
+    TCCR1B = 0;
+    TCCR1A = 0;
+    TIMSK1 = 0;
+    TCNT1 = 0;
+    OCR1A = ticks - 1;
+    OCR1B = ticks - 1;
+    TIFR1 = _BV(OCF1A) | _BV(OCF1B);
+
+    // ADC auto-triggered by Timer1 compare match B, clk/128 = 125 kHz
+    ADMUX = adcReference | adcChannels[0];
+    ADCSRB = _BV(ADTS2) | _BV(ADTS0);
+    ADCSRA = _BV(ADEN) | _BV(ADATE) | _BV(ADIE) | _BV(ADIF) | _BV(ADPS2) | _BV(ADPS1) | _BV(ADPS0);
+
+    TCCR1B = _BV(WGM12) | clockSelect;
+    sei();
+
+    return ADC_SAMPLER_OK;
+}
+
+
+// Called with interrupts off
+static void adc_sampler_stop(const uint8_t status)
+{
+    TCCR1B = 0;
+    ADCSRA = savedADCSRA & ~_BV(ADIF);
+    ADCSRB = savedADCSRB;
+    ADMUX = savedADMUX;
+
+    TIFR1 = _BV(OCF1A) | _BV(OCF1B);
+    TCNT1 = 0;
+    OCR1A = savedOCR1A;
+    OCR1B = savedOCR1B;
+    TIMSK1 = savedTIMSK1;
+    TCCR1A = savedTCCR1A;
+    TCCR1B = savedTCCR1B;
+
+    adcStatus = status;
+}
+
+
+ISR(ADC_vect)
+{
+    // adc_sampler_run_quiet() steps through the channels itself
+    if (adcQuiet) {
+        adc_sampler_store(ADC);
+        adcRemaining--;
+        return;
+    }
+
+    // The ADC triggers on the rising edge of OCF1B, so it must be cleared
+    // for the next compare match to start another conversion
+    TIFR1 = _BV(OCF1B);
+
+    adc_sampler_store(ADC);
+    if (--adcRemaining == 0) {
+        adc_sampler_stop(ADC_SAMPLER_OK);
+        return;
+    }
+
+    // Takes effect for the next conversion, which waits for the next trigger
+    if (++adcCurrent >= adcChannelCount)
+        adcCurrent = 0;
+    ADMUX = adcReference | adcChannels[adcCurrent];
+
+    // TCNT1 was cleared only a conversion time ago, so the new TOP can't
+    // already be behind it
+    if (adcJitterMask != 0) {
+        OCR1A = adcTicks - 1 + (adc_sampler_random() & adcJitterMask);
+        OCR1B = OCR1A;
+    }
+}
+
+
+// Plain polled conversions of 'mux', the first 'discard' thrown away.  The
+// ADC interrupt stays off, so this needs no help from the batch engine beyond
+// it being idle, and ADMUX/ADCSRA are put back afterwards.  The ADC may have
+// been off: the first conversion after enabling it takes 25 ADC clocks
+// instead of 13, but is otherwise fine.
+static uint32_t adc_sampler_polled(const uint8_t mux, const uint8_t samples, const uint8_t discard)
+{
+    uint8_t adcsra;
+    uint8_t admux;
+    uint32_t sum = 0;
+    uint8_t i;
+
+    adc_sampler_wait();
+    adcsra = ADCSRA;
+    admux = ADMUX;
+
+    ADMUX = adcReference | mux;
+    ADCSRA = _BV(ADEN) | _BV(ADIF) | _BV(ADPS2) | _BV(ADPS1) | _BV(ADPS0);
+
+    for (i = 0; i < samples + discard; i++) {
+        ADCSRA |= _BV(ADSC);
+        while (ADCSRA & _BV(ADSC))
+            ;
+        if (i >= discard)
+            sum += ADC;
+    }
+
+    ADMUX = admux;
+    ADCSRA = adcsra | _BV(ADIF);						// drop our completion flag
+    return sum;
+}
+
+
+// The discarded conversions also cover the bandgap's start-up time
+uint32_t adc_sampler_bandgap(const uint8_t samples)
+{
+    return adc_sampler_polled(ADC_SAMPLER_BANDGAP_CHANNEL, samples, ADC_SAMPLER_BANDGAP_DISCARD);
+}
+
+
+uint16_t adc_sampler_single(const uint8_t pin)
+{
+    return adc_sampler_polled(adc_sampler_channel(pin), 1, 0);
+}
+
+
+uint8_t adc_sampler_wait(void)
+{
+    for (;;) {
+        cli();
+        if (adcStatus != ADC_SAMPLER_BUSY) {
+            sei();
+            break;
+        }
+        if (millis() - adcStartMillis >= adcTimeoutMillis) {
+            adc_sampler_stop(ADC_SAMPLER_TIMEOUT);
+            sei();
+            break;
+        }
+        // Same as twi_async_wait(): no interrupt can slip in between the
+        // check and sleep_cpu(), the instruction after sei() always runs
+        set_sleep_mode(SLEEP_MODE_IDLE);
+        sleep_enable();
+        sei();
+        sleep_cpu();
+        sleep_disable();
+    }
+    return adcStatus;
+}
+
+#else
+
+/*==========================+
+|	analogRead fallback		|
++==========================*/
+
+// Runs the whole batch before returning, whatever the mode
+uint8_t adc_sampler_start(const uint8_t *pins, const uint8_t pinCount, const uint16_t samples, const uint16_t rateHz, const uint8_t mode)
+{
+    uint32_t periodMicros;
+    uint32_t waitMicros;
+    uint16_t jitterMask;
+    uint8_t status;
+
+    status = adc_sampler_prepare(pins, pinCount, samples, rateHz);
+    if (status != ADC_SAMPLER_OK)
+        return status;
+
+    periodMicros = 1000000UL / rateHz;
+    jitterMask = (mode & ADC_SAMPLER_DITHER) ? adc_sampler_jitter_mask(periodMicros) : 0;
+    while (adcRemaining > 0) {
+        waitMicros = periodMicros + (adc_sampler_random() & jitterMask);
+        if (waitMicros >= 1000)
+            delay(waitMicros / 1000);
+        delayMicroseconds(waitMicros % 1000);
+
+        adc_sampler_store(analogRead(pins[adcCurrent]));
+        adcRemaining--;
+        if (++adcCurrent >= adcChannelCount)
+            adcCurrent = 0;
+    }
+    adcStatus = ADC_SAMPLER_OK;
+    return ADC_SAMPLER_OK;
+}
+
+
+uint8_t adc_sampler_wait(void)
+{
+    return adcStatus;
+}
+
+
+// analogRead() can't select the bandgap
+uint32_t adc_sampler_bandgap(const uint8_t)
+{
+    return 0;
+}
+
+
+// analogRead() expects the ADC enabled, as the Arduino core leaves it
+uint16_t adc_sampler_single(const uint8_t pin)
+{
+    uint8_t adcsra = ADCSRA;
+    uint16_t value;
+
+    ADCSRA = adcsra | _BV(ADEN) | _BV(ADPS2) | _BV(ADPS1) | _BV(ADPS0);
+    value = analogRead(pin);
+    ADCSRA = adcsra;
+    return value;
+}
+
+#endif
+
+
+// A batch that couldn't run, or was cut short, is made up from what was
+// sampled (or a single analogRead()) rather than returning a sum that reads
+// as a low voltage.  The scaling is split into quotient and remainder:
+// sum * samples would pass 32 bits past about 1000 full scale conversions of
+// a 4096 sample batch, while remainder * samples stays below 65535^2.
+uint32_t adc_sampler_collect(const uint8_t pin, const uint16_t samples, const uint16_t rateHz, const uint8_t mode)
+{
+    uint16_t count = 0;
+    uint32_t sum;
+
+    if (adc_sampler_start(&pin, 1, samples, rateHz, mode) == ADC_SAMPLER_OK) {
+        if (adc_sampler_wait() == ADC_SAMPLER_OK)
+            return adc_sampler_sum(0);
+        count = adc_sampler_count(0);
+    }
+
+    if (count == 0)
+        return (uint32_t)analogRead(pin) * samples;
+    sum = adc_sampler_sum(0);
+    return sum / count * samples + sum % count * samples / count;
+}
+
+
+// Oversampling and decimation: the sum of 4^n samples shifted right by n
+// (rounded) has n more bits than a single conversion, provided the input
+// carries some noise.  A 12 bit reading costs 16 samples, 13 bits 64.
+uint16_t adc_sampler_oversample(const uint8_t pin, const uint8_t extraBits, const uint16_t rateHz, const uint8_t mode)
+{
+    uint8_t bits = (extraBits > ADC_SAMPLER_EXTRA_BITS_MAX) ? ADC_SAMPLER_EXTRA_BITS_MAX : extraBits;
+    uint32_t sum;
+
+    sum = adc_sampler_collect(pin, 1U << (2 * bits), rateHz, mode | ADC_SAMPLER_DITHER);
+    if (bits == 0)
+        return sum;
+    return (sum + (1UL << (bits - 1))) >> bits;
+}
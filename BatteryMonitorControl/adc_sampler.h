@@ -0,0 +1,108 @@
+/**
+ *  My Extension to some open source application
+ *
+ *  Copyright 2022 by Edward Figarsky <efigarsky@gmail.com>
+ *
+ * This file is part of an open source application.
+ *
+ * Some open source application is free software: you can redistribute
+ * it and/or modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * Some open source application is distributed in the hope that it will
+ * be useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * @license GPL-3.0+ <http://spdx.org/licenses/GPL-3.0+>
+ */
+#pragma once
+#ifndef _adc_sampler_h_
+#define _adc_sampler_h_
+
+#include "Arduino.h"
+#include "config.h"
+
+/*
+  Interrupt-driven ADC batches.
+
+  adc_sampler_start() asks for N samples per channel, at R conversions per
+  second, over a list of up to ADC_SAMPLER_CHANNELS_MAX analog pins (taken in
+  turn).  Timer1 compare match B triggers each conversion and the ADC
+  interrupt stores the result, so adc_sampler_wait() can idle the CPU in
+  SLEEP_MODE_IDLE until the batch is done.  Per-channel sums and counts are
+  kept as the samples arrive, and the last ADC_SAMPLER_BUFFER raw samples stay
+  in a ring buffer for anyone who wants more than the average.
+
+  Timer1 drives the PWM relay on pin 9 between batches, so its registers are
+  saved when a batch starts and put back when it ends.
+
+  In ADC_SAMPLER_QUIET mode each conversion instead runs with the CPU in
+  SLEEP_MODE_ADC (ADC noise reduction), woken by the conversion-complete
+  interrupt, and the time between samples is spent in SLEEP_MODE_IDLE.  Timer1
+  is left alone, and adc_sampler_start() only returns once the batch is done.
+  With the digital noise gone, fewer samples give the same precision.
+
+  ADC_SAMPLER_DITHER can be added to either mode: every sample period is then
+  stretched by a pseudo-random amount of up to a quarter period, so samples
+  don't lock onto periodic interference (ripple, the PWM relay, the LCD).
+  adc_sampler_oversample() uses it to trade 4^n samples for n extra bits; this
+  needs at least half an LSB of noise on the input, which the ADC gets with the
+  CPU running (ADC_SAMPLER_TIMED) but may not in ADC_SAMPLER_QUIET.
+
+  adc_sampler_bandgap() converts the internal 1.1 V bandgap against the
+  selected reference, which is how the reference itself can be measured.
+  adc_sampler_single() is one conversion with the ADC powered up just for it,
+  for a quick look while it is suspended around sleep.
+
+  adc_sampler_suspend()/adc_sampler_resume() switch the ADC off around
+  power-down sleep and back on after it.
+
+  With CONFIG_ADC_SAMPLER undefined (or on a non-AVR target) the same API is
+  served synchronously through analogRead() and delay().
+*/
+
+#define ADC_SAMPLER_CHANNELS_MAX	4
+#define ADC_SAMPLER_BUFFER			16		// raw samples kept, must be a power of two
+
+#define ADC_SAMPLER_TIMED			0		/* Timer1 triggered, CPU idles while the batch runs */
+#define ADC_SAMPLER_QUIET			1		/* each conversion in ADC noise reduction sleep */
+#define ADC_SAMPLER_DITHER			2		/* flag: randomise sample timing */
+
+#define ADC_SAMPLER_EXTRA_BITS_MAX	6		// 4096 samples, a 16 bit result
+
+#define ADC_SAMPLER_BANDGAP_CHANNEL	0x0E	// MUX3:0 for the 1.1 V bandgap on the 328P
+#define ADC_SAMPLER_BANDGAP_DISCARD	2		// conversions thrown away while it settles
+
+#define ADC_SAMPLER_OK				0
+#define ADC_SAMPLER_BUSY			1		/* a batch is still running */
+#define ADC_SAMPLER_TIMEOUT			2		/* the batch took far longer than it should, aborted */
+#define ADC_SAMPLER_BAD_REQUEST		3		/* no channels, too many, or a zero rate */
+
+void adc_sampler_begin(const uint8_t reference);
+uint8_t adc_sampler_start(const uint8_t *pins, const uint8_t pinCount, const uint16_t samples, const uint16_t rateHz, const uint8_t mode);
+uint8_t adc_sampler_busy(void);
+uint8_t adc_sampler_wait(void);
+uint32_t adc_sampler_sum(const uint8_t channel);
+uint16_t adc_sampler_count(const uint8_t channel);
+uint8_t adc_sampler_recent(uint16_t *buf, uint8_t n);
+uint8_t adc_sampler_suspend(void);
+void adc_sampler_resume(const uint8_t adcsra);
+
+// blocking single-channel batch, returns the sum of the samples
+uint32_t adc_sampler_collect(const uint8_t pin, const uint16_t samples, const uint16_t rateHz, const uint8_t mode);
+
+// blocking oversampled reading with 10 + extraBits bits, costs 4^extraBits samples
+uint16_t adc_sampler_oversample(const uint8_t pin, const uint8_t extraBits, const uint16_t rateHz, const uint8_t mode);
+
+// sum of 'samples' bandgap conversions against the reference, 0 if unsupported
+uint32_t adc_sampler_bandgap(const uint8_t samples);
+
+// one conversion of 'pin', leaving the ADC as it was found (even if off)
+uint16_t adc_sampler_single(const uint8_t pin);
+
+#endif
@@ -0,0 +1,248 @@
+/**
+ *  My Extension to some open source application
+ *
+ *  Copyright 2022 by Edward Figarsky <efigarsky@gmail.com>
+ *
+ * This file is part of an open source application.
+ *
+ * Some open source application is free software: you can redistribute
+ * it and/or modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * Some open source application is distributed in the hope that it will
+ * be useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * @license GPL-3.0+ <http://spdx.org/licenses/GPL-3.0+>
+ */
+#include "at24c32.h"
+
+#ifndef CONFIG_ASYNC_TWI
+ #include <Wire.h>
+#endif
+
+
+uint8_t at24c32_read(const uint16_t addr, uint8_t *buf, uint16_t len)
+{
+    uint8_t tx[2];
+    uint16_t at = addr;
+    uint8_t chunk;
+
+    while (len > 0) {
+        chunk = (len > AT24C32_PAGE_SIZE) ? AT24C32_PAGE_SIZE : len;
+        tx[0] = at >> 8;
+        tx[1] = at & 0xFF;
+        if (twi_async_transfer(AT24C32_I2C_ADDR, tx, 2, buf, chunk, AT24C32_TIMEOUT) != TWI_ASYNC_OK)
+            return 0;
+        at += chunk;
+        buf += chunk;
+        len -= chunk;
+    }
+    return 1;
+}
+
+
+// Every transaction stays inside one page; a write that crossed a page
+// boundary would wrap around to the start of the same page.
+uint8_t at24c32_write(uint16_t addr, const uint8_t *buf, uint16_t len)
+{
+    uint8_t tx[AT24C32_CHUNK_MAX + 2];
+    uint8_t chunk;
+    uint8_t i;
+
+    while (len > 0) {
+        chunk = AT24C32_PAGE_SIZE - (addr % AT24C32_PAGE_SIZE);
+        if (chunk > AT24C32_CHUNK_MAX)
+            chunk = AT24C32_CHUNK_MAX;
+        if (chunk > len)
+            chunk = len;
+
+        tx[0] = addr >> 8;
+        tx[1] = addr & 0xFF;
+        for (i = 0; i < chunk; i++)
+            tx[i + 2] = buf[i];
+
+        // NAKed while the previous write cycle is still running, retried
+        if (twi_async_transfer(AT24C32_I2C_ADDR, tx, chunk + 2, NULL, 0, AT24C32_TIMEOUT) != TWI_ASYNC_OK)
+            return 0;
+        addr += chunk;
+        buf += chunk;
+        len -= chunk;
+    }
+    return 1;
+}
+
+
+/*==========================+
+|	Record log				|
++==========================*/
+
+static uint16_t at24c32_log_slot_addr(const AT24C32Log *log, const uint16_t slot)
+{
+    return log->base + AT24C32_LOG_HEADER_SIZE + slot * (log->recordSize + 2);
+}
+
+
+static uint8_t at24c32_log_header_matches(const AT24C32Log *log, uint8_t *matches)
+{
+    uint8_t header[AT24C32_LOG_HEADER_SIZE];
+
+    if (!at24c32_read(log->base, header, AT24C32_LOG_HEADER_SIZE))
+        return 0;
+    *matches = header[0] == (AT24C32_LOG_MAGIC >> 8) && header[1] == (AT24C32_LOG_MAGIC & 0xFF)
+        && header[2] == log->version && header[3] == log->recordSize;
+    return 1;
+}
+
+
+static uint16_t at24c32_log_next_seq(const uint16_t seq)
+{
+    return (seq + 1 == AT24C32_LOG_EMPTY) ? 0 : seq + 1;
+}
+
+
+static uint8_t at24c32_log_read_seq(const AT24C32Log *log, const uint16_t slot, uint16_t *seq)
+{
+    uint8_t buf[2];
+
+    if (!at24c32_read(at24c32_log_slot_addr(log, slot) + log->recordSize, buf, 2))
+        return 0;
+    *seq = (buf[0] << 8) | buf[1];
+    return 1;
+}
+
+
+// Finds the head: the first slot whose sequence number doesn't follow the
+// previous slot's.  One two-byte read per slot.
+static uint8_t at24c32_log_scan(AT24C32Log *log)
+{
+    uint16_t prev;
+    uint16_t seq;
+    uint16_t i;
+
+    if (!at24c32_log_read_seq(log, 0, &prev))
+        return 0;
+    if (prev == AT24C32_LOG_EMPTY)
+        return 1;
+
+    for (i = 1; i < log->slots; i++) {
+        if (!at24c32_log_read_seq(log, i, &seq))
+            return 0;
+        if (seq != at24c32_log_next_seq(prev)) {
+            // Either the unused tail of a log that never wrapped, or the
+            // oldest record of one that did
+            log->head = i;
+            log->count = (seq == AT24C32_LOG_EMPTY) ? i : log->slots;
+            log->seq = at24c32_log_next_seq(prev);
+            return 1;
+        }
+        prev = seq;
+    }
+
+    // Every slot in order: the last write was the last slot
+    log->count = log->slots;
+    log->seq = at24c32_log_next_seq(prev);
+    return 1;
+}
+
+
+// Sets the log up over 'length' bytes from 'base' and finds where it left
+// off.  'version' is the caller's layout of the records: bump it whenever
+// that changes, and a log written with another version (or record size, or
+// none at all) is erased.  Returns 0, with the log disabled, if the EEPROM
+// doesn't answer, there is no room for a record or a slot won't fit a page.
+uint8_t at24c32_log_init(AT24C32Log *log, const uint16_t base, const uint16_t length, const uint8_t recordSize, const uint8_t version)
+{
+    uint8_t matches;
+
+    log->base = base;
+    log->recordSize = recordSize;
+    log->version = version;
+    log->slots = (length < AT24C32_LOG_HEADER_SIZE) ? 0 : (length - AT24C32_LOG_HEADER_SIZE) / (recordSize + 2);
+    log->head = 0;
+    log->count = 0;
+    log->seq = 0;
+
+    if (log->slots == 0 || recordSize > AT24C32_PAGE_SIZE - 2 || !at24c32_log_header_matches(log, &matches)) {
+        log->slots = 0;
+        return 0;
+    }
+    if (!matches) {
+        at24c32_log_erase(log);
+        return 1;
+    }
+    if (!at24c32_log_scan(log)) {
+        log->slots = 0;
+        return 0;
+    }
+    return 1;
+}
+
+
+// Record and sequence number go in as one write, the number last: if a
+// reset cuts the write short at a page boundary the slot still carries the
+// number of whatever it held before, which doesn't follow the previous
+// slot's, so the scan never takes a half-written record as new.
+uint8_t at24c32_log_append(AT24C32Log *log, const void *record)
+{
+    uint8_t slot[AT24C32_PAGE_SIZE];
+
+    if (log->slots == 0)
+        return 0;
+
+    memcpy(slot, record, log->recordSize);
+    slot[log->recordSize] = log->seq >> 8;
+    slot[log->recordSize + 1] = log->seq & 0xFF;
+    if (!at24c32_write(at24c32_log_slot_addr(log, log->head), slot, log->recordSize + 2))
+        return 0;
+
+    log->head = (log->head + 1) % log->slots;
+    if (log->count < log->slots)
+        log->count++;
+    log->seq = at24c32_log_next_seq(log->seq);
+    return 1;
+}
+
+
+// age 0 is the newest record, age count - 1 the oldest
+uint8_t at24c32_log_read(AT24C32Log *log, const uint16_t age, void *record)
+{
+    uint16_t slot;
+
+    if (age >= log->count)
+        return 0;
+
+    slot = (log->head + log->slots - 1 - age) % log->slots;
+    return at24c32_read(at24c32_log_slot_addr(log, slot), (uint8_t *)record, log->recordSize);
+}
+
+
+// Erases every slot to 0xFF, a page per write cycle, and then writes the
+// header, so an erase cut short is simply done again at the next init.
+void at24c32_log_erase(AT24C32Log *log)
+{
+    uint8_t empty[AT24C32_PAGE_SIZE];
+    uint8_t header[AT24C32_LOG_HEADER_SIZE] = { AT24C32_LOG_MAGIC >> 8, AT24C32_LOG_MAGIC & 0xFF, log->version, log->recordSize };
+    uint16_t addr = at24c32_log_slot_addr(log, 0);
+    uint16_t end = at24c32_log_slot_addr(log, log->slots);
+    uint16_t chunk;
+
+    memset(empty, 0xFF, sizeof(empty));
+    while (addr < end) {
+        chunk = AT24C32_PAGE_SIZE - (addr % AT24C32_PAGE_SIZE);
+        if (chunk > end - addr)
+            chunk = end - addr;
+        at24c32_write(addr, empty, chunk);
+        addr += chunk;
+    }
+    at24c32_write(log->base, header, AT24C32_LOG_HEADER_SIZE);
+
+    log->head = 0;
+    log->count = 0;
+    log->seq = 0;
+}
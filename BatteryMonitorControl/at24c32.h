@@ -0,0 +1,89 @@
+/**
+ *  My Extension to some open source application
+ *
+ *  Copyright 2022 by Edward Figarsky <efigarsky@gmail.com>
+ *
+ * This file is part of an open source application.
+ *
+ * Some open source application is free software: you can redistribute
+ * it and/or modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * Some open source application is distributed in the hope that it will
+ * be useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * @license GPL-3.0+ <http://spdx.org/licenses/GPL-3.0+>
+ */
+#pragma once
+#ifndef _at24c32_h_
+#define _at24c32_h_
+
+#include "Arduino.h"
+#include "config.h"
+#include "twi_async.h"
+
+/*
+  AT24C32 (4 KB I2C EEPROM) as fitted next to the DS3231 on the common RTC
+  modules, plus a record log kept in it.
+
+  Writes are split on 32-byte page boundaries so each piece is a single page
+  write.  The chip ignores its address while a write cycle is running, and
+  twi_async_transfer() retries NAKs, so the next access simply waits for the
+  previous cycle to finish (ACK polling) instead of sleeping a fixed tWR.
+
+  The log starts with a small header (a magic number, the caller's layout
+  version and the record size); if it doesn't match what at24c32_log_init()
+  is asked for, the log is erased rather than read back as the wrong records.
+  After it comes a ring of fixed-size slots, each one record followed by its
+  16-bit sequence number, packed end to end across pages so no space is lost
+  to page tails.  A slot goes in with one write: a single write cycle, or two
+  when it straddles a page.  The sequence number is last, so a write cut short
+  by a reset leaves the slot's old number, and the record is never taken for
+  a complete one.  Nothing but the EEPROM itself
+  is needed to find the head again after a reset: it is the first slot whose
+  sequence number doesn't follow its predecessor's.
+*/
+
+#define AT24C32_I2C_ADDR		0x57	// A0-A2 pulled high on the RTC modules
+#define AT24C32_SIZE			4096
+#define AT24C32_PAGE_SIZE		32
+#define AT24C32_TIMEOUT			25		// ms, tWR is 20 ms max at 1.8V
+
+// Largest data chunk per transaction: two address bytes go first, and Wire
+// has a 32 byte buffer
+#ifdef CONFIG_ASYNC_TWI
+ #define AT24C32_CHUNK_MAX		AT24C32_PAGE_SIZE
+#else
+ #define AT24C32_CHUNK_MAX		(BUFFER_LENGTH - 2)
+#endif
+
+#define AT24C32_LOG_EMPTY		0xFFFF	// sequence number of an erased slot
+#define AT24C32_LOG_MAGIC		0x4C32	// "L2", first in the log header; changes with the slot layout
+#define AT24C32_LOG_HEADER_SIZE	4		// magic, layout version, record size
+
+struct at24c32LogStruct {
+    uint16_t	base;			// first byte of the log, where the header is
+    uint16_t	slots;			// number of slots, 0 if the log is unusable
+    uint8_t		recordSize;		// bytes per record
+    uint8_t		version;		// layout version of the records, see at24c32_log_init()
+    uint16_t	head;			// slot the next record goes to
+    uint16_t	count;			// slots holding a record
+    uint16_t	seq;			// sequence number of the next record
+};
+typedef struct at24c32LogStruct AT24C32Log;
+
+uint8_t at24c32_read(const uint16_t addr, uint8_t *buf, uint16_t len);
+uint8_t at24c32_write(uint16_t addr, const uint8_t *buf, uint16_t len);
+
+uint8_t at24c32_log_init(AT24C32Log *log, const uint16_t base, const uint16_t length, const uint8_t recordSize, const uint8_t version);
+uint8_t at24c32_log_append(AT24C32Log *log, const void *record);
+uint8_t at24c32_log_read(AT24C32Log *log, const uint16_t age, void *record);
+void at24c32_log_erase(AT24C32Log *log);
+
+#endif
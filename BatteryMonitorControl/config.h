@@ -10,4 +10,22 @@
 //#define CONFIG_UNIXTIME
 #endif
 
+#if defined(__AVR_ATmega328P__) || defined(__AVR_ATmega168__)
+ // drive the RTC over our own interrupt-driven TWI engine (twi_async.cpp) and
+ // let the CPU idle while bytes are on the wire.  This owns the TWI interrupt,
+ // so Wire must not be linked in: comment this out to go back to Wire.
+ #define CONFIG_ASYNC_TWI
+
+ // sample the ADC from Timer1 compare match B and the ADC interrupt
+ // (adc_sampler.cpp) while the CPU idles.  Timer1 is borrowed, and given back,
+ // for each batch: comment this out to go back to analogRead() and delay().
+ #define CONFIG_ADC_SAMPLER
+
+ // while in power-down sleep, let the watchdog wake the CPU every so often
+ // for one conversion of a watched pin (DS3231Helpers.cpp), so a dip is seen
+ // before the next RTC alarm.  This owns the watchdog interrupt: comment this
+ // out to sleep until the alarm, or to use the watchdog for something else.
+ #define CONFIG_SLEEP_WATCH
+#endif
+
 #endif
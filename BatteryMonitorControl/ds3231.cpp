@@ -36,9 +36,9 @@
    
 */
 
-#include <Wire.h>
 #include <stdio.h>
 #include "ds3231.h"
+#include "twi_async.h"
 
 #ifdef __AVR__
  #include <avr/pgmspace.h>
@@ -68,6 +68,94 @@ bit1 A2IE   Alarm2 interrupt enable (1 to enable)
 bit0 A1IE   Alarm1 interrupt enable (1 to enable)
 */
 
+// bus transport, every transaction goes through the twi_async engine
+
+static uint8_t snapshotRegs[DS3231_SNAPSHOT_LEN];	// landing buffer for DS3231_snapshot_start()
+
+static uint8_t DS3231_write(const uint8_t addr, const uint8_t *buf, const uint8_t len)
+{
+    uint8_t tx[DS3231_SNAPSHOT_LEN + 1];
+    uint8_t i;
+
+    tx[0] = addr;
+    for (i = 0; i < len; i++)
+        tx[i + 1] = buf[i];
+
+    return twi_async_transfer(DS3231_I2C_ADDR, tx, len + 1, NULL, 0, DS3231_TRANSACTION_TIMEOUT) == TWI_ASYNC_OK;
+}
+
+static uint8_t DS3231_read(const uint8_t addr, uint8_t *buf, const uint8_t len)
+{
+    return twi_async_transfer(DS3231_I2C_ADDR, &addr, 1, buf, len, DS3231_TRANSACTION_TIMEOUT) == TWI_ASYNC_OK;
+}
+
+// Write-through shadow copies of the registers the MCU owns.  Reads are served
+// from RAM and writes that would not change anything never reach the bus.
+// The chip drops back to its power-on defaults after a reset, so the shadows
+// are thrown away whenever OSF is seen or DS3231_invalidate_cache() is called.
+
+#define SHADOW_CONTROL	0x01
+#define SHADOW_STATUS	0x02
+#define SHADOW_ALARM1	0x04
+#define SHADOW_ALARM2	0x08
+#define SHADOW_AGING	0x10
+
+#define DS3231_STATUS_FLAGS	(DS3231_STATUS_A1F | DS3231_STATUS_A2F | DS3231_STATUS_OSF)
+
+static uint8_t shadowValid = 0;
+static uint8_t shadowControl;		// CONV is never kept, the chip clears it by itself
+static uint8_t shadowStatus;		// last status seen; only EN32KHZ is really ours
+static uint8_t shadowAlarm1[4];
+static uint8_t shadowAlarm2[3];
+static uint8_t shadowAging;
+
+// Last temperature read from the chip and the RTC time (epoch) it was read at.
+// The chip itself only converts every 64 seconds unless told to.
+static int16_t  tempCache;
+static uint32_t tempCacheEpoch;
+static bool     tempCacheValid = false;
+
+void DS3231_invalidate_cache(void)
+{
+    shadowValid = 0;
+}
+
+static void DS3231_shadow_status(const uint8_t sreg)
+{
+    if (sreg & DS3231_STATUS_OSF)
+        DS3231_invalidate_cache();
+
+    shadowStatus = sreg;
+    shadowValid |= SHADOW_STATUS;
+}
+
+// Writes only the bytes of a register block that differ from its shadow (one
+// burst from the first to the last changed byte), then updates the shadow.
+static void DS3231_write_block(const uint8_t addr, const uint8_t *buf, uint8_t *shadow,
+                               const uint8_t len, const uint8_t validBit)
+{
+    uint8_t first = 0;
+    uint8_t last = len - 1;
+    uint8_t i;
+
+    if (shadowValid & validBit) {
+        while (first < len && buf[first] == shadow[first])
+            first++;
+        if (first == len)
+            return;	// nothing changed
+        while (buf[last] == shadow[last])
+            last--;
+    }
+
+    if (DS3231_write(addr + first, buf + first, last - first + 1)) {
+        for (i = 0; i < len; i++)
+            shadow[i] = buf[i];
+        shadowValid |= validBit;
+    } else {
+        shadowValid &= ~validBit;
+    }
+}
+
 void DS3231_init(const uint8_t ctrl_reg)
 {
     DS3231_set_creg(ctrl_reg);
@@ -88,42 +176,23 @@ void DS3231_set(DateTimeDS3231 t)
 
     uint8_t TimeDate[7] = { t.sec, t.min, t.hour, t.wday, t.mday, t.mon, t.year_s };
 
-    Wire.beginTransmission(DS3231_I2C_ADDR);
-    Wire.write(DS3231_TIME_CAL_ADDR);
     for (i = 0; i <= 6; i++) {
         TimeDate[i] = dectobcd(TimeDate[i]);
         if (i == 5)
             TimeDate[5] += century;
-        Wire.write(TimeDate[i]);
     }
-    Wire.endTransmission();
+    DS3231_write(DS3231_TIME_CAL_ADDR, TimeDate, 7);
 }
 
-void DS3231_get(DateTimeDS3231 *t)
+static void DS3231_decode_time(const uint8_t *regs, DateTimeDS3231 *t)
 {
     uint8_t TimeDate[7];        //second,minute,hour,dow,day,month,year
     uint8_t century = 0;
     uint8_t i, n;
     uint16_t year_full;
 
-    Wire.beginTransmission(DS3231_I2C_ADDR);
-    Wire.write(DS3231_TIME_CAL_ADDR);
-    Wire.endTransmission();
-
-	uint8_t gotData = false;
-	uint32_t start = millis(); // start timeout
-	while(millis()-start < DS3231_TRANSACTION_TIMEOUT){
-	  if (Wire.requestFrom(DS3231_I2C_ADDR, 7) == 7) {
-      	gotData = true;
-      	break;
-      }
-      delay(2);
-    }
-	if (!gotData)
-    	return; // error timeout
-    
     for (i = 0; i <= 6; i++) {
-        n = Wire.read();
+        n = regs[i];
         if (i == 5) {
             TimeDate[5] = bcdtodec(n & 0x1F);
             century = (n & 0x80) >> 7;
@@ -144,41 +213,117 @@ void DS3231_get(DateTimeDS3231 *t)
     t->year_s	= TimeDate[6];
 	t->leapYear	= isLeapYear(year_full);
 	t->yday		= MMDDtoDDD(t);
+	t->epoch	= DS3231_epoch(t);
 #ifdef CONFIG_UNIXTIME
     t->unixtime	= get_unixtime(*t);
 #endif
 }
 
+static int8_t DS3231_decode_aging(const uint8_t reg)
+{
+    if ((reg & 0x80) != 0)
+        return reg | ~((1 << 8) - 1);     // if negative get two's complement
+    return reg;
+}
+
+// The register is a two's complement whole degree byte and two fraction bits,
+// so in quarter degrees it is just the two put next to each other
+static int16_t DS3231_decode_treg(const uint8_t temp_msb, const uint8_t temp_lsb)
+{
+    int8_t nint;
+
+    if ((temp_msb & 0x80) != 0)
+        nint = temp_msb | ~((1 << 8) - 1);      // if negative get two's complement
+    else
+        nint = temp_msb;
+
+    return nint * DS3231_TEMP_STEPS + (temp_lsb >> 6);
+}
+
+void DS3231_get(DateTimeDS3231 *t)
+{
+    uint8_t regs[7];
+
+    if (!DS3231_read(DS3231_TIME_CAL_ADDR, regs, 7))
+    	return; // error timeout
+
+    DS3231_decode_time(regs, t);
+}
+
+static void DS3231_decode_snapshot(const uint8_t *regs, DS3231Snapshot *s)
+{
+    uint8_t i;
+
+    // Everything was just read from the chip, so every shadow is current
+    DS3231_shadow_status(regs[DS3231_STATUS_ADDR]);
+    shadowControl = regs[DS3231_CONTROL_ADDR] & ~DS3231_CONTROL_CONV;
+    for (i = 0; i < 4; i++)
+        shadowAlarm1[i] = regs[DS3231_ALARM1_ADDR + i];
+    for (i = 0; i < 3; i++)
+        shadowAlarm2[i] = regs[DS3231_ALARM2_ADDR + i];
+    shadowAging = regs[DS3231_AGING_OFFSET_ADDR];
+    shadowValid = SHADOW_CONTROL | SHADOW_STATUS | SHADOW_ALARM1 | SHADOW_ALARM2 | SHADOW_AGING;
+
+    DS3231_decode_time(regs, &s->time);
+    s->control		= regs[DS3231_CONTROL_ADDR];
+    s->status		= regs[DS3231_STATUS_ADDR];
+    s->aging		= DS3231_decode_aging(regs[DS3231_AGING_OFFSET_ADDR]);
+    s->temperature	= DS3231_decode_treg(regs[DS3231_TEMPERATURE_ADDR], regs[DS3231_TEMPERATURE_ADDR + 1]);
+
+    tempCache		= s->temperature;
+    tempCacheEpoch	= s->time.epoch;
+    tempCacheValid	= true;
+}
+
+// Reads every register (00h..12h) in a single bus transaction and decodes
+// time, control, status, aging and temperature.  This replaces the separate
+// DS3231_get/DS3231_get_treg/DS3231_get_sreg round trips on the wake path.
+// Returns 1 on success, 0 on timeout (the snapshot is left untouched).
+uint8_t DS3231_snapshot(DS3231Snapshot *s)
+{
+    uint8_t regs[DS3231_SNAPSHOT_LEN];
+
+    if (!DS3231_read(DS3231_TIME_CAL_ADDR, regs, DS3231_SNAPSHOT_LEN))
+    	return 0; // error timeout
+
+    DS3231_decode_snapshot(regs, s);
+    return 1;
+}
+
+// Split-phase DS3231_snapshot(): start the burst read and return at once so the
+// caller can do other work (e.g. ADC sampling) while the bus transfer runs.
+// Nothing else may use the bus until DS3231_snapshot_finish() is called.
+uint8_t DS3231_snapshot_start(void)
+{
+    const uint8_t addr = DS3231_TIME_CAL_ADDR;
+
+    if (twi_async_wait(DS3231_TRANSACTION_TIMEOUT) == TWI_ASYNC_BUSY)
+        return 0;
+    return twi_async_submit(DS3231_I2C_ADDR, &addr, 1, snapshotRegs, DS3231_SNAPSHOT_LEN, NULL) == TWI_ASYNC_OK;
+}
+
+uint8_t DS3231_snapshot_finish(DS3231Snapshot *s)
+{
+    // A NAK'd or aborted burst falls back to the blocking, retrying read
+    if (twi_async_wait(DS3231_TRANSACTION_TIMEOUT) != TWI_ASYNC_OK)
+        return DS3231_snapshot(s);
+
+    DS3231_decode_snapshot(snapshotRegs, s);
+    return 1;
+}
+
 void DS3231_set_addr(const uint8_t addr, const uint8_t val)
 {
-    Wire.beginTransmission(DS3231_I2C_ADDR);
-    Wire.write(addr);
-    Wire.write(val);
-    Wire.endTransmission();
+    DS3231_write(addr, &val, 1);
 }
 
 uint8_t DS3231_get_addr(const uint8_t addr)
 {
     uint8_t rv;
 
-    Wire.beginTransmission(DS3231_I2C_ADDR);
-    Wire.write(addr);
-    Wire.endTransmission();
-
-	uint8_t gotData = false;
-	uint32_t start = millis(); // start timeout
-	while(millis()-start < DS3231_TRANSACTION_TIMEOUT){
-	  if (Wire.requestFrom(DS3231_I2C_ADDR, 1) == 1) {
-      	gotData = true;
-      	break;
-      }
-      delay(2);
-    }
-	if (!gotData)
+    if (!DS3231_read(addr, &rv, 1))
     	return 0; // error timeout
 
-    rv = Wire.read();
-
     return rv;
 }
 
@@ -188,13 +333,25 @@ uint8_t DS3231_get_addr(const uint8_t addr)
 
 void DS3231_set_creg(const uint8_t val)
 {
+    // CONV always has to go out, it starts a conversion
+    if ((shadowValid & SHADOW_CONTROL) && shadowControl == val)
+        return;
+
     DS3231_set_addr(DS3231_CONTROL_ADDR, val);
+    shadowControl = val & ~DS3231_CONTROL_CONV;
+    shadowValid |= SHADOW_CONTROL;
 }
 
 uint8_t DS3231_get_creg(void)
 {
     uint8_t rv;
+
+    if (shadowValid & SHADOW_CONTROL)
+        return shadowControl;
+
     rv = DS3231_get_addr(DS3231_CONTROL_ADDR);
+    shadowControl = rv & ~DS3231_CONTROL_CONV;
+    shadowValid |= SHADOW_CONTROL;
     return rv;
 }
 
@@ -208,18 +365,32 @@ bit1 A2F      Alarm 2 Flag - (1 if alarm2 was triggered)
 bit0 A1F      Alarm 1 Flag - (1 if alarm1 was triggered)
 */
 
+// The flag bits belong to the chip, so status writes are never skipped and
+// status reads always go to the bus.  Writing 1 to a flag leaves it alone.
 void DS3231_set_sreg(const uint8_t val)
 {
     DS3231_set_addr(DS3231_STATUS_ADDR, val);
+    shadowStatus = val;
+    shadowValid |= SHADOW_STATUS;
 }
 
 uint8_t DS3231_get_sreg(void)
 {
     uint8_t rv;
     rv = DS3231_get_addr(DS3231_STATUS_ADDR);
+    DS3231_shadow_status(rv);
     return rv;
 }
 
+// Status value that leaves every flag untouched and keeps EN32KHZ as it is
+static uint8_t DS3231_sreg_keep_flags(void)
+{
+    if (!(shadowValid & SHADOW_STATUS))
+        DS3231_get_sreg();
+
+    return (shadowStatus & DS3231_STATUS_EN32KHZ) | DS3231_STATUS_FLAGS;
+}
+
 // aging register
 
 void DS3231_set_aging(const int8_t val)
@@ -236,7 +407,12 @@ void DS3231_set_aging(const int8_t val)
      * +1 means -0.1ppm
      * -1 means -0.1ppm
      */
+    if ((shadowValid & SHADOW_AGING) && shadowAging == reg)
+        return;
+
     DS3231_set_addr(DS3231_AGING_OFFSET_ADDR, reg);
+    shadowAging = reg;
+    shadowValid |= SHADOW_AGING;
     /*
      * A conversion mut be done to forace the new aging value.
 	 */
@@ -245,54 +421,74 @@ void DS3231_set_aging(const int8_t val)
 
 int8_t DS3231_get_aging(void)
 {
-    uint8_t reg;
-    int8_t rv;
-
-    reg = DS3231_get_addr(DS3231_AGING_OFFSET_ADDR);
-
-    if ((reg & 0x80) != 0)
-        rv = reg | ~((1 << 8) - 1);     // if negative get two's complement
-    else
-        rv = reg;
-
-    return rv;
+    if (!(shadowValid & SHADOW_AGING)) {
+        shadowAging = DS3231_get_addr(DS3231_AGING_OFFSET_ADDR);
+        shadowValid |= SHADOW_AGING;
+    }
+    return DS3231_decode_aging(shadowAging);
 }
 
 // temperature register
 
 float DS3231_get_treg()
 {
-    float rv;
-    uint8_t temp_msb, temp_lsb;
-    int8_t nint;
+    uint8_t temp[2];
 
-    Wire.beginTransmission(DS3231_I2C_ADDR);
-    Wire.write(DS3231_TEMPERATURE_ADDR);
-    Wire.endTransmission();
-
-	uint8_t gotData = false;
-	uint32_t start = millis(); // start timeout
-	while(millis()-start < DS3231_TRANSACTION_TIMEOUT){
-	  if (Wire.requestFrom(DS3231_I2C_ADDR, 2) == 2) {
-      	gotData = true;
-      	break;
-      }
-      delay(2);
-    }
-	if (!gotData)
+    if (!DS3231_read(DS3231_TEMPERATURE_ADDR, temp, 2))
     	return 0; // error timeout
 
-    temp_msb = Wire.read();
-    temp_lsb = Wire.read() >> 6;
+    return DS3231_decode_treg(temp[0], temp[1]) / (float)DS3231_TEMP_STEPS;
+}
 
-    if ((temp_msb & 0x80) != 0)
-        nint = temp_msb | ~((1 << 8) - 1);      // if negative get two's complement
-    else
-        nint = temp_msb;
+// Waits, idling between polls, until neither CONV nor BSY is set.
+// Returns 0 if the chip is still busy after DS3231_CONVERSION_TIMEOUT.
+static uint8_t DS3231_wait_conversion(void)
+{
+    uint8_t regs[2];                                            // control, status
+    uint32_t start = millis();
+
+    do {
+        if (!DS3231_read(DS3231_CONTROL_ADDR, regs, 2))
+            return 0;
+        DS3231_shadow_status(regs[1]);
+        if (!(regs[0] & DS3231_CONTROL_CONV) && !(regs[1] & DS3231_STATUS_BUSY))
+            return 1;
+        twi_async_idle_millis(DS3231_CONVERSION_POLL);
+    } while (millis() - start < DS3231_CONVERSION_TIMEOUT);
+
+    return 0;
+}
 
-    rv = 0.25 * temp_lsb + nint;
+// Temperature in quarter degrees C, either the cached value (DS3231_TEMP_CACHED) or
+// the result of a conversion forced right now (DS3231_TEMP_FRESH).  'now' is
+// the current RTC epoch; *age (may be NULL) gets the seconds since the value
+// was read from the chip.  Cached reads cost no bus time; the first one, or a
+// failed conversion, falls back to reading the register.
+// Returns 1 on success, 0 on timeout.
+uint8_t DS3231_get_temperature(const uint8_t mode, const uint32_t now, int16_t *temperature, uint32_t *age)
+{
+    uint8_t temp[2];
+
+    if (mode == DS3231_TEMP_FRESH || !tempCacheValid) {
+        // A conversion the chip started on its own has to finish before CONV
+        // may be set, and ours is done when both CONV and BSY drop again
+        if (mode == DS3231_TEMP_FRESH && DS3231_wait_conversion()) {
+            DS3231_set_creg(DS3231_get_creg() | DS3231_CONTROL_CONV);
+            DS3231_wait_conversion();
+        }
+
+        if (!DS3231_read(DS3231_TEMPERATURE_ADDR, temp, 2))
+            return 0; // error timeout
+
+        tempCache = DS3231_decode_treg(temp[0], temp[1]);
+        tempCacheEpoch = now;
+        tempCacheValid = true;
+    }
 
-    return rv;
+    *temperature = tempCache;
+    if (age != NULL)
+        *age = (now > tempCacheEpoch) ? now - tempCacheEpoch : 0;
+    return 1;
 }
 
 void DS3231_set_32kHz_output(const uint8_t on)
@@ -301,13 +497,13 @@ void DS3231_set_32kHz_output(const uint8_t on)
      * Note, the pin1 is an open drain pin, therefore a pullup
      * resistor is required to use the output.
      */
+    uint8_t sreg = DS3231_sreg_keep_flags();
+
     if (on) {
-        uint8_t sreg = DS3231_get_sreg();
         sreg &= ~DS3231_STATUS_OSF;
         sreg |= DS3231_STATUS_EN32KHZ;
         DS3231_set_sreg(sreg);
-    } else {
-        uint8_t sreg = DS3231_get_sreg();
+    } else if (sreg & DS3231_STATUS_EN32KHZ) {
         sreg &= ~DS3231_STATUS_EN32KHZ;
         DS3231_set_sreg(sreg);
     }
@@ -322,17 +518,14 @@ void DS3231_set_a1(const uint8_t s, const uint8_t mi, const uint8_t h, const uin
     uint8_t t[4] = { s, mi, h, d };
     uint8_t i;
 
-    Wire.beginTransmission(DS3231_I2C_ADDR);
-    Wire.write(DS3231_ALARM1_ADDR);
-
     for (i = 0; i <= 3; i++) {
         if (i == 3) {
-            Wire.write(dectobcd(t[3]) | (flags[3] << 7) | (flags[4] << 6));
+            t[3] = dectobcd(t[3]) | (flags[3] << 7) | (flags[4] << 6);
         } else
-            Wire.write(dectobcd(t[i]) | (flags[i] << 7));
+            t[i] = dectobcd(t[i]) | (flags[i] << 7);
     }
 
-    Wire.endTransmission();
+    DS3231_write_block(DS3231_ALARM1_ADDR, t, shadowAlarm1, 4, SHADOW_ALARM1);
 }
 
 void DS3231_get_a1(char *buf, const uint8_t len)
@@ -342,24 +535,17 @@ void DS3231_get_a1(char *buf, const uint8_t len)
     uint8_t f[5];               // flags
     uint8_t i;
 
-    Wire.beginTransmission(DS3231_I2C_ADDR);
-    Wire.write(DS3231_ALARM1_ADDR);
-    Wire.endTransmission();
-
-	uint8_t gotData = false;
-	uint32_t start = millis(); // start timeout
-	while(millis()-start < DS3231_TRANSACTION_TIMEOUT){
-	  if (Wire.requestFrom(DS3231_I2C_ADDR, 4) == 4) {
-      	gotData = true;
-      	break;
-      }
-      delay(2);
-    }
-	if (!gotData)
+    if (shadowValid & SHADOW_ALARM1) {
+        for (i = 0; i <= 3; i++)
+            n[i] = shadowAlarm1[i];
+    } else if (DS3231_read(DS3231_ALARM1_ADDR, n, 4)) {
+        for (i = 0; i <= 3; i++)
+            shadowAlarm1[i] = n[i];
+        shadowValid |= SHADOW_ALARM1;
+    } else
     	return; // error timeout
 
     for (i = 0; i <= 3; i++) {
-        n[i] = Wire.read();
         f[i] = (n[i] & 0x80) >> 7;
         t[i] = bcdtodec(n[i] & 0x7F);
     }
@@ -379,7 +565,7 @@ void DS3231_clear_a1f(void)
 {
     uint8_t reg_val;
 
-    reg_val = DS3231_get_sreg() & ~DS3231_STATUS_A1F;
+    reg_val = DS3231_sreg_keep_flags() & ~DS3231_STATUS_A1F;
     DS3231_set_sreg(reg_val);
 }
 
@@ -394,17 +580,14 @@ void DS3231_set_a2(const uint8_t mi, const uint8_t h, const uint8_t d, const uin
     uint8_t t[3] = { mi, h, d };
     uint8_t i;
 
-    Wire.beginTransmission(DS3231_I2C_ADDR);
-    Wire.write(DS3231_ALARM2_ADDR);
-
     for (i = 0; i <= 2; i++) {
         if (i == 2) {
-            Wire.write(dectobcd(t[2]) | (flags[2] << 7) | (flags[3] << 6));
+            t[2] = dectobcd(t[2]) | (flags[2] << 7) | (flags[3] << 6);
         } else
-            Wire.write(dectobcd(t[i]) | (flags[i] << 7));
+            t[i] = dectobcd(t[i]) | (flags[i] << 7);
     }
 
-    Wire.endTransmission();
+    DS3231_write_block(DS3231_ALARM2_ADDR, t, shadowAlarm2, 3, SHADOW_ALARM2);
 }
 
 void DS3231_get_a2(char *buf, const uint8_t len)
@@ -414,27 +597,17 @@ void DS3231_get_a2(char *buf, const uint8_t len)
     uint8_t f[4];               // flags
     uint8_t i;
 
-    Wire.beginTransmission(DS3231_I2C_ADDR);
-    Wire.write(DS3231_ALARM2_ADDR);
-    Wire.endTransmission();
-
-    Wire.requestFrom(DS3231_I2C_ADDR, 4);
-	uint8_t gotData = false;
-	uint32_t start = millis(); // start timeout
-	while(millis()-start < DS3231_TRANSACTION_TIMEOUT){
-	  if (Wire.requestFrom(DS3231_I2C_ADDR, 3) == 3) {
-      	gotData = true;
-      	break;
-      }
-      delay(2);
-    }
-	if (!gotData)
+    if (shadowValid & SHADOW_ALARM2) {
+        for (i = 0; i <= 2; i++)
+            n[i] = shadowAlarm2[i];
+    } else if (DS3231_read(DS3231_ALARM2_ADDR, n, 3)) {
+        for (i = 0; i <= 2; i++)
+            shadowAlarm2[i] = n[i];
+        shadowValid |= SHADOW_ALARM2;
+    } else
     	return; // error timeout
 
-    
-
     for (i = 0; i <= 2; i++) {
-        n[i] = Wire.read();
         f[i] = (n[i] & 0x80) >> 7;
         t[i] = bcdtodec(n[i] & 0x7F);
     }
@@ -452,7 +625,7 @@ void DS3231_clear_a2f(void)
 {
     uint8_t reg_val;
 
-    reg_val = DS3231_get_sreg() & ~DS3231_STATUS_A2F;
+    reg_val = DS3231_sreg_keep_flags() & ~DS3231_STATUS_A2F;
     DS3231_set_sreg(reg_val);
 }
 
@@ -461,6 +634,15 @@ uint8_t DS3231_triggered_a2(void)
     return  DS3231_get_sreg() & DS3231_STATUS_A2F;
 }
 
+// clears A1F and A2F in one write
+void DS3231_clear_alarm_flags(void)
+{
+    uint8_t reg_val;
+
+    reg_val = DS3231_sreg_keep_flags() & ~(DS3231_STATUS_A1F | DS3231_STATUS_A2F);
+    DS3231_set_sreg(reg_val);
+}
+
 // helpers
 
 #ifdef CONFIG_UNIXTIME
@@ -494,6 +676,55 @@ uint32_t get_unixtime(DateTimeDS3231 t)
 }
 #endif
 
+// days since 01.01.2000 for a proleptic Gregorian date (Howard Hinnant's
+// days_from_civil, shifted to our epoch), no tables and no loops
+static int32_t days_from_civil(int16_t y, const uint8_t m, const uint8_t d)
+{
+    int16_t era;
+    uint16_t yoe, doy;
+    uint32_t doe;
+
+    y -= (m <= 2);
+    era = (y >= 0 ? y : y - 399) / 400;
+    yoe = y - era * 400;                                        // [0, 399]
+    doy = (153 * (m > 2 ? m - 3 : m + 9) + 2) / 5 + d - 1;      // [0, 365]
+    doe = yoe * 365UL + yoe / 4 - yoe / 100 + doy;              // [0, 146096]
+    return era * 146097L + (int32_t)doe - 730425L;              // 730425 = days from 0000-03-01 to 2000-01-01
+}
+
+// returns the number of seconds since 01.01.2000 00:00:00, valid for 2000..2136
+uint32_t DS3231_epoch(const DateTimeDS3231 *t)
+{
+    uint32_t days = days_from_civil(t->year, t->mon, t->mday);
+
+    return ((days * 24UL + t->hour) * 60 + t->min) * 60 + t->sec;
+}
+
+// inverse of DS3231_epoch() (Hinnant's civil_from_days), wday is 1 for Sunday
+void DS3231_epoch_to_time(const uint32_t epoch, DateTimeDS3231 *t)
+{
+    uint32_t days = epoch / SECONDS_PER_DAY;
+    uint32_t secs = epoch % SECONDS_PER_DAY;
+    uint32_t z = days + 730425L;                                // days since 0000-03-01
+    uint16_t era = z / 146097L;
+    uint32_t doe = z - era * 146097L;                           // [0, 146096]
+    uint16_t yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;   // [0, 399]
+    uint16_t doy = doe - (365UL * yoe + yoe / 4 - yoe / 100);   // [0, 365]
+    uint8_t mp = (5 * doy + 2) / 153;                           // [0, 11]
+
+    t->mday		= doy - (153 * mp + 2) / 5 + 1;
+    t->mon		= (mp < 10) ? mp + 3 : mp - 9;
+    t->year		= yoe + era * 400 + (t->mon <= 2);
+    t->year_s	= t->year - 2000;
+    t->hour		= secs / 3600;
+    t->min		= (secs / 60) % 60;
+    t->sec		= secs % 60;
+    t->wday		= (days + 6) % 7 + 1;                           // 01.01.2000 was a Saturday
+    t->leapYear	= isLeapYear(t->year);
+    t->yday		= MMDDtoDDD(t);
+    t->epoch	= epoch;
+}
+
 uint8_t dectobcd(const uint8_t val)
 {
     return ((val / 10 * 16) + (val % 10));
@@ -9,9 +9,12 @@
 
 #include "config.h"
 
-#define	DS3231_TRANSACTION_TIMEOUT	100 // Wire NAK/Busy timeout in ms
+#define	DS3231_TRANSACTION_TIMEOUT	100 // I2C NAK/Busy timeout in ms
+#define	DS3231_CONVERSION_TIMEOUT	250 // forced temperature conversion, tCONV is 200 ms max
+#define	DS3231_CONVERSION_POLL		10  // ms between CONV/BSY polls
 
 #define SECONDS_FROM_1970_TO_2000 946684800
+#define SECONDS_PER_DAY           86400UL
 
 // i2c slave address of the DS3231 chip
 #define DS3231_I2C_ADDR             0x68
@@ -24,6 +27,7 @@
 #define DS3231_STATUS_ADDR          0x0F
 #define DS3231_AGING_OFFSET_ADDR    0x10
 #define DS3231_TEMPERATURE_ADDR     0x11
+#define DS3231_SNAPSHOT_LEN         0x13	// 00h..12h, every register on the chip
 
 // control register bits
 #define DS3231_CONTROL_A1IE     0x1		/* Alarm 2 Interrupt Enable */
@@ -56,6 +60,7 @@ struct ts {
     int16_t		year;		/* year */
     uint16_t	yday;		/* day in the year */
 	bool		leapYear;	/* true if it's a leap year */
+    uint32_t	epoch;		/* seconds since 01.01.2000 00:00:00 */
 #ifdef CONFIG_UNIXTIME
     uint32_t unixtime;      /* seconds since 01.01.1970 00:00:00 UTC*/
 #endif
@@ -63,13 +68,29 @@ struct ts {
 
 typedef struct ts DateTimeDS3231;
 
+struct snapshot {
+    DateTimeDS3231	time;			/* decoded timekeeping registers 00h-06h */
+    uint8_t		control;		/* control register 0Eh */
+    uint8_t		status;			/* status register 0Fh */
+    int8_t		aging;			/* aging offset register 10h */
+    int16_t		temperature;	/* temperature registers 11h-12h, in 0.25 degree C steps */
+};
+
+typedef struct snapshot DS3231Snapshot;
+
 void DS3231_init(const uint8_t creg);
 void DS3231_set(DateTimeDS3231 t);
 void DS3231_get(DateTimeDS3231 *t);
+uint8_t DS3231_snapshot(DS3231Snapshot *s);
+uint8_t DS3231_snapshot_start(void);
+uint8_t DS3231_snapshot_finish(DS3231Snapshot *s);
 
 void DS3231_set_addr(const uint8_t addr, const uint8_t val);
 uint8_t DS3231_get_addr(const uint8_t addr);
 
+// shadow register cache, call after the chip was reset behind our back
+void DS3231_invalidate_cache(void);
+
 // control/status register
 void DS3231_set_creg(const uint8_t val);
 uint8_t DS3231_get_creg(void);
@@ -82,7 +103,14 @@ void DS3231_set_aging(const int8_t val);
 int8_t DS3231_get_aging(void);
 
 // temperature register
+#define DS3231_TEMP_CACHED	0	/* last value read from the chip, no bus traffic */
+#define DS3231_TEMP_FRESH	1	/* force a conversion and wait for it */
+
+#define DS3231_TEMP_STEPS	4	/* temperatures below are in 1/4 degree C */
+#define DS3231_TEMP_PERIOD	64	/* seconds between the chip's own conversions */
+
 float DS3231_get_treg(void);
+uint8_t DS3231_get_temperature(const uint8_t mode, const uint32_t now, int16_t *temperature, uint32_t *age);
 
 void DS3231_set_32kHz_output(const uint8_t on);
 
@@ -98,8 +126,12 @@ void DS3231_get_a2(char *buf, const uint8_t len);
 void DS3231_clear_a2f(void);
 uint8_t DS3231_triggered_a2(void);
 
+void DS3231_clear_alarm_flags(void);
+
 // helpers
 uint32_t get_unixtime(DateTimeDS3231 t);
+uint32_t DS3231_epoch(const DateTimeDS3231 *t);
+void DS3231_epoch_to_time(const uint32_t epoch, DateTimeDS3231 *t);
 uint8_t dectobcd(const uint8_t val);
 uint8_t bcdtodec(const uint8_t val);
 uint8_t inp2toi(char *cmd, const uint16_t seek);
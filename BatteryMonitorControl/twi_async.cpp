@@ -0,0 +1,329 @@
+/**
+ *  My Extension to some open source application
+ *
+ *  Copyright 2022 by Edward Figarsky <efigarsky@gmail.com>
+ *
+ * This file is part of an open source application.
+ *
+ * Some open source application is free software: you can redistribute
+ * it and/or modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * Some open source application is distributed in the hope that it will
+ * be useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * @license GPL-3.0+ <http://spdx.org/licenses/GPL-3.0+>
+ */
+#include "twi_async.h"
+
+#ifdef __AVR__
+ #include <avr/interrupt.h>
+ #include <avr/sleep.h>
+#endif
+
+#ifdef CONFIG_ASYNC_TWI
+ #include <util/twi.h>
+#else
+ #include <Wire.h>
+#endif
+
+
+static volatile uint8_t	twiStatus = TWI_ASYNC_OK;
+static twi_async_callback	twiDone = NULL;
+
+
+// Sleep until the next interrupt.  Timer 0 keeps running in SLEEP_MODE_IDLE,
+// so millis() based timeouts still work around this.  Off the AVR there is
+// nothing to sleep on, so a millisecond is simply let go by.
+void twi_async_idle(void)
+{
+#ifdef __AVR__
+    set_sleep_mode(SLEEP_MODE_IDLE);
+    sleep_enable();
+    sleep_cpu();
+    sleep_disable();
+#else
+    delay(1);
+#endif
+}
+
+
+void twi_async_idle_millis(const uint16_t ms)
+{
+    uint32_t start = millis();
+
+    while (millis() - start < ms)
+        twi_async_idle();
+}
+
+
+uint8_t twi_async_status(void)
+{
+    return twiStatus;
+}
+
+
+uint8_t twi_async_busy(void)
+{
+    return twiStatus == TWI_ASYNC_BUSY;
+}
+
+
+#ifdef CONFIG_ASYNC_TWI
+
+/*==========================+
+|	Interrupt-driven engine	|
++==========================*/
+
+#define TWCR_BASE	(_BV(TWEN) | _BV(TWIE))
+
+static uint8_t			twiSla;
+static uint8_t			twiTxBuffer[TWI_ASYNC_BUFFER_MAX];
+static uint8_t			twiTxLen;
+static volatile uint8_t	twiTxIndex;
+static uint8_t *		twiRxBuffer;
+static uint8_t			twiRxLen;
+static volatile uint8_t	twiRxIndex;
+
+
+void twi_async_begin(void)
+{
+    // Internal pull-ups, same as Wire.begin() does
+    digitalWrite(SDA, HIGH);
+    digitalWrite(SCL, HIGH);
+
+    TWSR = 0;											// prescaler 1
+    TWBR = ((F_CPU / TWI_ASYNC_FREQ) - 16) / 2;
+    TWCR = _BV(TWEN);
+
+    twiStatus = TWI_ASYNC_OK;
+}
+
+
+uint8_t twi_async_submit(const uint8_t sla, const uint8_t *tx, const uint8_t txLen,
+                         uint8_t *rx, const uint8_t rxLen, twi_async_callback done)
+{
+    uint8_t i;
+
+    if (twiStatus == TWI_ASYNC_BUSY)
+        return TWI_ASYNC_BUSY;
+    if (txLen > TWI_ASYNC_BUFFER_MAX)
+        return TWI_ASYNC_TOO_LONG;
+
+    // The STOP from the previous transaction may still be on the wire
+    while (TWCR & _BV(TWSTO))
+        ;
+
+    twiSla = sla;
+    for (i = 0; i < txLen; i++)
+        twiTxBuffer[i] = tx[i];
+    twiTxLen = txLen;
+    twiTxIndex = 0;
+    twiRxBuffer = rx;
+    twiRxLen = rxLen;
+    twiRxIndex = 0;
+    twiDone = done;
+    twiStatus = TWI_ASYNC_BUSY;
+
+    TWCR = TWCR_BASE | _BV(TWINT) | _BV(TWSTA);
+    return TWI_ASYNC_OK;
+}
+
+
+static void twi_async_finish(const uint8_t status)
+{
+    if (status == TWI_ASYNC_BUS_ERROR)
+        TWCR = _BV(TWEN) | _BV(TWINT);					// just release the bus
+    else
+        TWCR = _BV(TWEN) | _BV(TWINT) | _BV(TWSTO);
+
+    twiStatus = status;
+    if (twiDone != NULL)
+        (*twiDone)(status);
+}
+
+
+void twi_async_abort(void)
+{
+    uint8_t oldSREG = SREG;
+
+    cli();
+    if (twiStatus == TWI_ASYNC_BUSY) {
+        TWCR = _BV(TWEN) | _BV(TWINT) | _BV(TWSTO);
+        twiStatus = TWI_ASYNC_TIMEOUT;
+    }
+    SREG = oldSREG;
+}
+
+
+ISR(TWI_vect)
+{
+    switch (TW_STATUS) {
+    case TW_START:
+    case TW_REP_START:
+        TWDR = (twiTxIndex < twiTxLen || twiRxLen == 0) ? (twiSla << 1) : ((twiSla << 1) | 1);
+        TWCR = TWCR_BASE | _BV(TWINT);
+        break;
+
+    case TW_MT_SLA_ACK:
+    case TW_MT_DATA_ACK:
+        if (twiTxIndex < twiTxLen) {
+            TWDR = twiTxBuffer[twiTxIndex++];
+            TWCR = TWCR_BASE | _BV(TWINT);
+        } else if (twiRxLen > 0) {
+            TWCR = TWCR_BASE | _BV(TWINT) | _BV(TWSTA);	// repeated START for the read phase
+        } else {
+            twi_async_finish(TWI_ASYNC_OK);
+        }
+        break;
+
+    case TW_MR_SLA_ACK:
+        // ACK every byte but the last one
+        TWCR = TWCR_BASE | _BV(TWINT) | ((twiRxLen > 1) ? _BV(TWEA) : 0);
+        break;
+
+    case TW_MR_DATA_ACK:
+        twiRxBuffer[twiRxIndex++] = TWDR;
+        TWCR = TWCR_BASE | _BV(TWINT) | ((twiRxIndex < twiRxLen - 1) ? _BV(TWEA) : 0);
+        break;
+
+    case TW_MR_DATA_NACK:
+        twiRxBuffer[twiRxIndex++] = TWDR;
+        twi_async_finish(TWI_ASYNC_OK);
+        break;
+
+    case TW_MT_SLA_NACK:
+    case TW_MT_DATA_NACK:
+    case TW_MR_SLA_NACK:
+        twi_async_finish(TWI_ASYNC_NACK);
+        break;
+
+    case TW_MT_ARB_LOST:
+    case TW_BUS_ERROR:
+    default:
+        twi_async_finish(TWI_ASYNC_BUS_ERROR);
+        break;
+    }
+}
+
+
+uint8_t twi_async_wait(const uint16_t timeoutMillis)
+{
+    uint32_t start = millis();
+
+    for (;;) {
+        cli();
+        if (twiStatus != TWI_ASYNC_BUSY) {
+            sei();
+            break;
+        }
+        if (millis() - start >= timeoutMillis) {
+            sei();
+            twi_async_abort();
+            break;
+        }
+        // Checking the flag and going to sleep must not be split by the TWI
+        // interrupt, or we would sleep through the completion.  The
+        // instruction after sei() always runs before a pending interrupt.
+        set_sleep_mode(SLEEP_MODE_IDLE);
+        sleep_enable();
+        sei();
+        sleep_cpu();
+        sleep_disable();
+    }
+    return twiStatus;
+}
+
+#else
+
+/*==========================+
+|	Wire-backed fallback	|
++==========================*/
+
+void twi_async_begin(void)
+{
+    Wire.begin();
+    twiStatus = TWI_ASYNC_OK;
+}
+
+
+// Runs the whole transaction through Wire before returning, so by the time the
+// caller sees the result nothing is ever "in flight".
+uint8_t twi_async_submit(const uint8_t sla, const uint8_t *tx, const uint8_t txLen,
+                         uint8_t *rx, const uint8_t rxLen, twi_async_callback done)
+{
+    uint8_t i;
+    uint8_t status = TWI_ASYNC_OK;
+
+    if (txLen > TWI_ASYNC_BUFFER_MAX || txLen > BUFFER_LENGTH)
+        return TWI_ASYNC_TOO_LONG;
+
+    if (txLen > 0) {
+        Wire.beginTransmission(sla);
+        for (i = 0; i < txLen; i++)
+            Wire.write(tx[i]);
+        if (Wire.endTransmission() != 0)
+            status = TWI_ASYNC_NACK;
+    }
+
+    if (status == TWI_ASYNC_OK && rxLen > 0) {
+        if (Wire.requestFrom(sla, rxLen) == rxLen) {
+            for (i = 0; i < rxLen; i++)
+                rx[i] = Wire.read();
+        } else {
+            status = TWI_ASYNC_NACK;
+        }
+    }
+
+    twiStatus = status;
+    twiDone = done;
+    if (twiDone != NULL)
+        (*twiDone)(status);
+    return TWI_ASYNC_OK;
+}
+
+
+void twi_async_abort(void)
+{
+}
+
+
+uint8_t twi_async_wait(const uint16_t)
+{
+    return twiStatus;
+}
+
+#endif
+
+
+uint8_t twi_async_transfer(const uint8_t sla, const uint8_t *tx, const uint8_t txLen,
+                           uint8_t *rx, const uint8_t rxLen, const uint16_t timeoutMillis)
+{
+    uint8_t status;
+    uint32_t start = millis(); // start timeout
+
+    // Somebody else's transaction may still own the bus
+    if (twi_async_wait(timeoutMillis) == TWI_ASYNC_BUSY)
+        return TWI_ASYNC_BUSY;
+
+    do {
+        status = twi_async_submit(sla, tx, txLen, rx, rxLen, NULL);
+        if (status != TWI_ASYNC_OK)
+            return status;
+
+        status = twi_async_wait(timeoutMillis);
+        if (status == TWI_ASYNC_OK || status == TWI_ASYNC_TIMEOUT)
+            return status;
+
+        // NAK or bus error, the device may be busy - back off and try again
+        twi_async_idle_millis(2);
+    } while (millis() - start < timeoutMillis);
+
+    return status;
+}
@@ -0,0 +1,70 @@
+/**
+ *  My Extension to some open source application
+ *
+ *  Copyright 2022 by Edward Figarsky <efigarsky@gmail.com>
+ *
+ * This file is part of an open source application.
+ *
+ * Some open source application is free software: you can redistribute
+ * it and/or modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * Some open source application is distributed in the hope that it will
+ * be useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * @license GPL-3.0+ <http://spdx.org/licenses/GPL-3.0+>
+ */
+#pragma once
+#ifndef _twi_async_h_
+#define _twi_async_h_
+
+#include "Arduino.h"
+#include "config.h"
+
+/*
+  Interrupt-driven I2C (TWI) master transactions.
+
+  A transaction is an optional write phase followed by an optional read phase
+  (joined by a repeated START), which covers the "set register pointer, then
+  read N bytes" pattern every device on our bus uses.  twi_async_submit()
+  returns immediately; completion is reported through the callback and
+  twi_async_busy()/twi_async_status().  twi_async_wait() idles the CPU in
+  SLEEP_MODE_IDLE until the TWI interrupt finishes the job.
+
+  With CONFIG_ASYNC_TWI undefined (or on a non-AVR target) the same API is
+  served synchronously through Wire, so callers don't need to care.
+*/
+
+#define TWI_ASYNC_OK			0		/* transaction completed */
+#define TWI_ASYNC_BUSY			1		/* a transaction is still in flight */
+#define TWI_ASYNC_NACK			2		/* address or data byte was not acknowledged */
+#define TWI_ASYNC_BUS_ERROR		3		/* arbitration lost or illegal START/STOP */
+#define TWI_ASYNC_TIMEOUT		4		/* gave up waiting, transaction aborted */
+#define TWI_ASYNC_TOO_LONG		5		/* write phase does not fit in the buffer */
+
+#define TWI_ASYNC_BUFFER_MAX	34		// write phase: 2 address bytes + one 32-byte EEPROM page
+#define TWI_ASYNC_FREQ			100000L	// SCL clock in Hz
+
+typedef void (*twi_async_callback)(uint8_t status);
+
+void twi_async_begin(void);
+uint8_t twi_async_submit(const uint8_t sla, const uint8_t *tx, const uint8_t txLen,
+                         uint8_t *rx, const uint8_t rxLen, twi_async_callback done);
+uint8_t twi_async_busy(void);
+uint8_t twi_async_status(void);
+uint8_t twi_async_wait(const uint16_t timeoutMillis);
+void twi_async_abort(void);
+void twi_async_idle(void);
+void twi_async_idle_millis(const uint16_t ms);
+
+// blocking transaction, retried on NACK until timeoutMillis has elapsed
+uint8_t twi_async_transfer(const uint8_t sla, const uint8_t *tx, const uint8_t txLen,
+                           uint8_t *rx, const uint8_t rxLen, const uint16_t timeoutMillis);
+
+#endif
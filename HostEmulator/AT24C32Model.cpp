@@ -0,0 +1,123 @@
+/**
+ *  My Extension to some open source application
+ *
+ *  Copyright 2022 by Edward Figarsky <efigarsky@gmail.com>
+ *
+ * This file is part of an open source application.
+ *
+ * Some open source application is free software: you can redistribute
+ * it and/or modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * Some open source application is distributed in the hope that it will
+ * be useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * @license GPL-3.0+ <http://spdx.org/licenses/GPL-3.0+>
+ */
+#include "AT24C32Model.h"
+#include <string.h>
+
+
+AT24C32Model::AT24C32Model()
+{
+	bus = NULL;
+	busAddress = 0;
+	pointer = 0;
+	writeLeft = 0;
+	erase();
+}
+
+
+AT24C32Model::~AT24C32Model()
+{
+	disconnect();
+}
+
+
+void AT24C32Model::connect(TwoWire& wire, uint8_t address)
+{
+	disconnect();
+	bus = &wire;
+	busAddress = address;
+	bus->attach(address, this);
+	hostAddClockListener(this);
+}
+
+
+void AT24C32Model::disconnect(void)
+{
+	if (bus != NULL)
+	{
+		bus->detach(busAddress);
+		hostRemoveClockListener(this);
+		bus = NULL;
+	}
+}
+
+
+void AT24C32Model::erase(void)
+{
+	memset(memory, 0xFF, sizeof(memory));
+	memset(pageCycles, 0, sizeof(pageCycles));
+	cycles = 0;
+}
+
+
+bool AT24C32Model::receive(const uint8_t* data, uint8_t length)
+{
+	uint16_t page;
+
+	if (busy() || length < 2)
+	{
+		return !busy() && length == 0;
+	}
+
+	pointer = ((data[0] << 8) | data[1]) % AT24C32_MODEL_SIZE;
+	if (length == 2)
+	{
+		return true;			// just setting the address for a read
+	}
+
+	// Only the low five address bits count up, so a long write wraps around
+	// to the start of its page
+	page = pointer & ~(AT24C32_MODEL_PAGE_SIZE - 1);
+	for (uint8_t i = 2; i < length; i++)
+	{
+		memory[pointer] = data[i];
+		pointer = page | ((pointer + 1) & (AT24C32_MODEL_PAGE_SIZE - 1));
+	}
+
+	writeLeft = AT24C32_MODEL_WRITE_MILLIS;
+	cycles++;
+	pageCycles[page / AT24C32_MODEL_PAGE_SIZE]++;
+	return true;
+}
+
+
+bool AT24C32Model::transmit(uint8_t* data, uint8_t quantity)
+{
+	if (busy())
+	{
+		return false;
+	}
+	for (uint8_t i = 0; i < quantity; i++)
+	{
+		data[i] = memory[pointer];
+		pointer = (pointer + 1) % AT24C32_MODEL_SIZE;
+	}
+	return true;
+}
+
+
+void AT24C32Model::advance(uint32_t fromMillis, uint32_t toMillis)
+{
+	uint32_t elapsed = toMillis - fromMillis;
+
+	writeLeft = (elapsed >= writeLeft) ? 0 : writeLeft - elapsed;
+}
@@ -0,0 +1,76 @@
+/**
+ *  My Extension to some open source application
+ *
+ *  Copyright 2022 by Edward Figarsky <efigarsky@gmail.com>
+ *
+ * This file is part of an open source application.
+ *
+ * Some open source application is free software: you can redistribute
+ * it and/or modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * Some open source application is distributed in the hope that it will
+ * be useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * @license GPL-3.0+ <http://spdx.org/licenses/GPL-3.0+>
+ */
+#pragma once
+#ifndef _AT24C32Model_h_
+#define _AT24C32Model_h_
+
+#include "Arduino.h"
+#include "Wire.h"
+#include "HostEmulator.h"
+
+#define AT24C32_MODEL_SIZE			4096
+#define AT24C32_MODEL_PAGE_SIZE		32
+#define AT24C32_MODEL_WRITE_MILLIS	5		// self-timed write cycle, 10 ms max at 5V
+
+/*
+  Model of an AT24C32 serial EEPROM as seen from the I2C bus.
+
+  - two address bytes, then data; a write wraps around inside its 32-byte page
+  - sequential reads from the current address, wrapping at the end of memory
+  - the chip NAKs everything while a write cycle runs, so ACK polling works
+  - starts out erased (all 0xFF) and counts write cycles per page
+
+  Write cycles only end as the host virtual clock moves on.
+*/
+class AT24C32Model : public I2CDevice, public HostClockListener {
+public:
+	AT24C32Model();
+	~AT24C32Model();
+
+	void connect(TwoWire& wire, uint8_t address);
+	void disconnect(void);
+	void erase(void);
+
+	uint8_t byteAt(uint16_t addr) const { return memory[addr % AT24C32_MODEL_SIZE]; }
+	uint32_t writeCycles(void) const { return cycles; }
+	uint32_t pageWrites(uint8_t page) const { return pageCycles[page]; }
+	bool busy(void) const { return writeLeft > 0; }
+
+	// I2CDevice
+	virtual bool receive(const uint8_t* data, uint8_t length);
+	virtual bool transmit(uint8_t* data, uint8_t quantity);
+
+	// HostClockListener
+	virtual void advance(uint32_t fromMillis, uint32_t toMillis);
+
+private:
+	TwoWire*	bus;
+	uint8_t		busAddress;
+	uint8_t		memory[AT24C32_MODEL_SIZE];
+	uint16_t	pointer;
+	uint32_t	writeLeft;
+	uint32_t	cycles;
+	uint32_t	pageCycles[AT24C32_MODEL_SIZE / AT24C32_MODEL_PAGE_SIZE];
+};
+
+#endif
@@ -0,0 +1,108 @@
+/**
+ *  My Extension to some open source application
+ *
+ *  Copyright 2022 by Edward Figarsky <efigarsky@gmail.com>
+ *
+ * This file is part of an open source application.
+ *
+ * Some open source application is free software: you can redistribute
+ * it and/or modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * Some open source application is distributed in the hope that it will
+ * be useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * @license GPL-3.0+ <http://spdx.org/licenses/GPL-3.0+>
+ */
+#pragma once
+#ifndef _HOST_ARDUINO_H_
+#define _HOST_ARDUINO_H_
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <math.h>
+#include "avr/io.h"
+#include "avr/pgmspace.h"
+#include "HostEmulator.h"
+
+typedef uint8_t byte;
+typedef bool boolean;
+
+#define HIGH			1
+#define LOW				0
+#define CHANGE			1
+#define FALLING			2
+#define RISING			3
+
+#define INPUT			0
+#define OUTPUT			1
+#define INPUT_PULLUP	2
+
+#define DEFAULT			1
+#define EXTERNAL		0
+#define INTERNAL		3
+
+#define A0				14
+#define A1				15
+#define A2				16
+#define A3				17
+#define A4				18
+#define A5				19
+#define SDA				18
+#define SCL				19
+
+#define F(x)			(x)
+#define bit(b)			(1UL << (b))
+#define digitalPinToInterrupt(p)	((p) == 2 ? 0 : ((p) == 3 ? 1 : -1))
+#define NOT_AN_INTERRUPT	-1
+
+#define noInterrupts()
+#define interrupts()
+
+template<class T, class U> static inline T min(T a, U b) { return (b < a) ? b : a; }
+template<class T, class U> static inline T max(T a, U b) { return (a < b) ? b : a; }
+template<class T, class U, class V> static inline T constrain(T x, U lo, V hi) { return (x < lo) ? lo : ((x > hi) ? hi : x); }
+
+unsigned long millis(void);
+unsigned long micros(void);
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t val);
+int digitalRead(uint8_t pin);
+int analogRead(uint8_t pin);
+void analogReference(uint8_t mode);
+void analogWrite(uint8_t pin, int val);
+
+void attachInterrupt(uint8_t interruptNum, void (*userFunc)(void), int mode);
+void detachInterrupt(uint8_t interruptNum);
+
+char* dtostrf(double val, signed char width, unsigned char prec, char* sout);
+
+class HostSerial {
+public:
+	void begin(unsigned long) {}
+	void flush(void) {}
+	void print(const char* s) { fputs(s, stdout); }
+	void print(char c) { putchar(c); }
+	void print(long n) { printf("%ld", n); }
+	void print(int n) { printf("%d", n); }
+	void print(unsigned long n) { printf("%lu", n); }
+	void print(unsigned int n) { printf("%u", n); }
+	void print(unsigned char n) { printf("%u", n); }
+	void print(double d) { printf("%.2f", d); }
+	template<class T> void println(T v) { print(v); putchar('\n'); }
+	void println(void) { putchar('\n'); }
+};
+extern HostSerial Serial;
+
+#endif
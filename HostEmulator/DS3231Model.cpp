@@ -0,0 +1,409 @@
+/**
+ *  My Extension to some open source application
+ *
+ *  Copyright 2022 by Edward Figarsky <efigarsky@gmail.com>
+ *
+ * This file is part of an open source application.
+ *
+ * Some open source application is free software: you can redistribute
+ * it and/or modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * Some open source application is distributed in the hope that it will
+ * be useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * @license GPL-3.0+ <http://spdx.org/licenses/GPL-3.0+>
+ */
+#include "DS3231Model.h"
+
+#define REG_SECONDS		0x00
+#define REG_MINUTES		0x01
+#define REG_HOURS		0x02
+#define REG_DAY			0x03
+#define REG_DATE		0x04
+#define REG_MONTH		0x05
+#define REG_YEAR		0x06
+#define REG_ALARM1		0x07
+#define REG_ALARM2		0x0B
+#define REG_CONTROL		0x0E
+#define REG_STATUS		0x0F
+#define REG_AGING		0x10
+#define REG_TEMP_MSB	0x11
+#define REG_TEMP_LSB	0x12
+
+#define CTRL_A1IE		0x01
+#define CTRL_A2IE		0x02
+#define CTRL_INTCN		0x04
+#define CTRL_CONV		0x20
+
+#define STAT_A1F		0x01
+#define STAT_A2F		0x02
+#define STAT_BSY		0x04
+#define STAT_EN32KHZ	0x08
+#define STAT_OSF		0x80
+
+#define MASK_BIT		0x80	// AxMx, "don't care" for this field
+#define DYDT_BIT		0x40
+#define HOUR_12			0x40
+#define HOUR_PM			0x20
+#define CENTURY_BIT		0x80
+
+static const uint8_t writeMask[DS3231_MODEL_REGISTERS] = {
+	0x7F, 0x7F, 0x7F, 0x07, 0x3F, 0x9F, 0xFF,		// time
+	0xFF, 0xFF, 0xFF, 0xFF,							// alarm 1
+	0xFF, 0xFF, 0xFF,								// alarm 2
+	0xFF, 0x8F, 0xFF,								// control, status, aging
+	0x00, 0x00										// temperature is read only
+};
+
+static uint8_t toDec(uint8_t bcd)
+{
+	return (bcd >> 4) * 10 + (bcd & 0x0F);
+}
+
+static uint8_t toBcd(uint8_t dec)
+{
+	return ((dec / 10) << 4) | (dec % 10);
+}
+
+static uint8_t daysInMonth(uint8_t month, uint8_t year)
+{
+	static const uint8_t days[12] = { 31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31 };
+
+	// The chip's leap year rule is "divisible by 4", good for 2000..2099
+	return (month == 2 && (year % 4) == 0) ? 29 : days[(month - 1) % 12];
+}
+
+// Hour register to 0..23, whichever mode it is in
+static uint8_t hourTo24(uint8_t reg)
+{
+	if (reg & HOUR_12)
+	{
+		uint8_t h = toDec(reg & 0x1F) % 12;
+		return (reg & HOUR_PM) ? h + 12 : h;
+	}
+	return toDec(reg & 0x3F);
+}
+
+static uint8_t hourFrom24(uint8_t hour, uint8_t modeReg)
+{
+	if (modeReg & HOUR_12)
+	{
+		uint8_t h = hour % 12;
+		return HOUR_12 | ((hour >= 12) ? HOUR_PM : 0) | toBcd(h == 0 ? 12 : h);
+	}
+	return toBcd(hour);
+}
+
+
+DS3231Model::DS3231Model()
+{
+	bus = NULL;
+	busAddress = 0;
+	interruptPin = -1;
+	conversionMillis = DS3231_MODEL_CONVERSION_MILLIS;
+	ambient = 25 * 4;
+	powerOnReset();
+}
+
+
+DS3231Model::~DS3231Model()
+{
+	disconnect();
+}
+
+
+void DS3231Model::connect(TwoWire& wire, uint8_t address)
+{
+	disconnect();
+	bus = &wire;
+	busAddress = address;
+	bus->attach(address, this);
+	hostAddClockListener(this);
+}
+
+
+void DS3231Model::disconnect(void)
+{
+	if (bus != NULL)
+	{
+		bus->detach(busAddress);
+		hostRemoveClockListener(this);
+		bus = NULL;
+	}
+}
+
+
+void DS3231Model::connectInterruptPin(uint8_t pin)
+{
+	interruptPin = pin;
+	updateInterruptPin();
+}
+
+
+// Registers as the datasheet gives them after power is first applied
+void DS3231Model::powerOnReset(void)
+{
+	memset(regs, 0, sizeof(regs));
+	regs[REG_DAY] = 0x01;
+	regs[REG_DATE] = 0x01;
+	regs[REG_MONTH] = 0x01;
+	regs[REG_CONTROL] = 0x1C;
+	regs[REG_STATUS] = STAT_OSF | STAT_EN32KHZ;
+	pointer = 0;
+	millisIntoSecond = 0;
+	driftNanos = 0;
+	seconds = 0;
+	converting = false;
+	conversionLeft = 0;
+	finishConversion();
+	updateInterruptPin();
+}
+
+
+bool DS3231Model::intAsserted(void) const
+{
+	uint8_t ctrl = regs[REG_CONTROL];
+	uint8_t stat = regs[REG_STATUS];
+
+	return (ctrl & CTRL_INTCN)
+		&& (((ctrl & CTRL_A1IE) && (stat & STAT_A1F)) || ((ctrl & CTRL_A2IE) && (stat & STAT_A2F)));
+}
+
+
+void DS3231Model::updateInterruptPin(void)
+{
+	if (interruptPin >= 0)
+	{
+		// INT/SQW is open drain
+		hostSetPinLevel(interruptPin, intAsserted() ? LOW : HOST_RELEASED);
+	}
+}
+
+
+void DS3231Model::writeRegister(uint8_t addr, uint8_t val)
+{
+	uint8_t old = regs[addr];
+
+	switch (addr)
+	{
+	case REG_SECONDS:
+		regs[addr] = val & writeMask[addr];
+		millisIntoSecond = 0;			// writing seconds resets the countdown chain
+		break;
+	case REG_CONTROL:
+		regs[addr] = val;
+		if (val & CTRL_CONV)
+		{
+			startConversion();
+		}
+		break;
+	case REG_STATUS:
+		// flags can only be cleared, BSY belongs to the chip
+		regs[addr] = (old & val & (STAT_OSF | STAT_A1F | STAT_A2F))
+			| (val & STAT_EN32KHZ)
+			| (old & STAT_BSY);
+		break;
+	default:
+		regs[addr] = (old & ~writeMask[addr]) | (val & writeMask[addr]);
+		break;
+	}
+	updateInterruptPin();
+}
+
+
+// First byte sets the register pointer, the rest are written with auto-increment
+bool DS3231Model::receive(const uint8_t* data, uint8_t length)
+{
+	if (length == 0)
+	{
+		return true;
+	}
+	pointer = data[0] % DS3231_MODEL_REGISTERS;
+	for (uint8_t i = 1; i < length; i++)
+	{
+		writeRegister(pointer, data[i]);
+		pointer = (pointer + 1) % DS3231_MODEL_REGISTERS;
+	}
+	return true;
+}
+
+
+bool DS3231Model::transmit(uint8_t* data, uint8_t quantity)
+{
+	for (uint8_t i = 0; i < quantity; i++)
+	{
+		data[i] = regs[pointer];
+		pointer = (pointer + 1) % DS3231_MODEL_REGISTERS;
+	}
+	return true;
+}
+
+
+void DS3231Model::startConversion(void)
+{
+	regs[REG_CONTROL] |= CTRL_CONV;
+	regs[REG_STATUS] |= STAT_BSY;
+	converting = true;
+	conversionLeft = conversionMillis;
+}
+
+
+void DS3231Model::finishConversion(void)
+{
+	regs[REG_TEMP_MSB] = (uint8_t)(ambient >> 2);
+	regs[REG_TEMP_LSB] = (uint8_t)((ambient & 0x03) << 6);
+	regs[REG_CONTROL] &= ~CTRL_CONV;
+	regs[REG_STATUS] &= ~STAT_BSY;
+	converting = false;
+}
+
+
+void DS3231Model::advance(uint32_t fromMillis, uint32_t toMillis)
+{
+	uint32_t left = toMillis - fromMillis;
+
+	while (left > 0)
+	{
+		uint32_t step = 1000 - millisIntoSecond;
+
+		if (converting && conversionLeft < step)
+		{
+			step = conversionLeft;
+		}
+		if (step > left)
+		{
+			step = left;
+		}
+		left -= step;
+		millisIntoSecond += step;
+		if (converting)
+		{
+			conversionLeft -= step;
+			if (conversionLeft == 0)
+			{
+				finishConversion();
+			}
+		}
+		if (millisIntoSecond >= 1000)
+		{
+			millisIntoSecond = 0;
+			tickSecond();
+		}
+	}
+}
+
+
+void DS3231Model::tickSecond(void)
+{
+	// Aging: +1 LSB slows the oscillator by about 0.1 ppm, -1 speeds it up
+	driftNanos -= (int8_t)regs[REG_AGING] * 100L;
+	if (driftNanos <= -1000000000L)
+	{
+		driftNanos += 1000000000L;
+		return;							// lost a second
+	}
+
+	incrementTime();
+	if (driftNanos >= 1000000000L)
+	{
+		driftNanos -= 1000000000L;
+		incrementTime();				// gained a second
+	}
+
+	seconds++;
+	if (!converting && (seconds % DS3231_MODEL_TCXO_SECONDS) == 0)
+	{
+		startConversion();
+		regs[REG_CONTROL] &= ~CTRL_CONV;	// automatic conversions only show BSY
+	}
+}
+
+
+void DS3231Model::incrementTime(void)
+{
+	uint8_t sec = toDec(regs[REG_SECONDS]) + 1;
+
+	if (sec >= 60)
+	{
+		uint8_t min = toDec(regs[REG_MINUTES]) + 1;
+
+		sec = 0;
+		if (min >= 60)
+		{
+			uint8_t hour = hourTo24(regs[REG_HOURS]) + 1;
+
+			min = 0;
+			if (hour >= 24)
+			{
+				uint8_t month = toDec(regs[REG_MONTH] & 0x1F);
+				uint8_t year = toDec(regs[REG_YEAR]);
+				uint8_t date = toDec(regs[REG_DATE]) + 1;
+				uint8_t century = regs[REG_MONTH] & CENTURY_BIT;
+
+				hour = 0;
+				regs[REG_DAY] = (regs[REG_DAY] % 7) + 1;
+				if (date > daysInMonth(month, year))
+				{
+					date = 1;
+					if (++month > 12)
+					{
+						month = 1;
+						if (++year > 99)
+						{
+							year = 0;
+							century ^= CENTURY_BIT;
+						}
+						regs[REG_YEAR] = toBcd(year);
+					}
+					regs[REG_MONTH] = century | toBcd(month);
+				}
+				regs[REG_DATE] = toBcd(date);
+			}
+			regs[REG_HOURS] = hourFrom24(hour, regs[REG_HOURS]);
+		}
+		regs[REG_MINUTES] = toBcd(min);
+	}
+	regs[REG_SECONDS] = toBcd(sec);
+
+	checkAlarms();
+}
+
+
+// A field takes part in the match unless its AxMx bit is set; the day/date
+// field compares against the day of week when DY/DT is set.
+static bool fieldMatches(uint8_t alarm, uint8_t value, uint8_t mask)
+{
+	return (alarm & MASK_BIT) || ((alarm & mask) == (value & mask));
+}
+
+void DS3231Model::checkAlarms(void)
+{
+	const uint8_t* a1 = &regs[REG_ALARM1];
+	const uint8_t* a2 = &regs[REG_ALARM2];
+
+	if (fieldMatches(a1[0], regs[REG_SECONDS], 0x7F)
+		&& fieldMatches(a1[1], regs[REG_MINUTES], 0x7F)
+		&& fieldMatches(a1[2], regs[REG_HOURS], 0x7F)
+		&& fieldMatches(a1[3], (a1[3] & DYDT_BIT) ? regs[REG_DAY] : regs[REG_DATE], 0x3F))
+	{
+		regs[REG_STATUS] |= STAT_A1F;
+	}
+
+	// Alarm 2 has no seconds register, it fires at 00 seconds
+	if (regs[REG_SECONDS] == 0
+		&& fieldMatches(a2[0], regs[REG_MINUTES], 0x7F)
+		&& fieldMatches(a2[1], regs[REG_HOURS], 0x7F)
+		&& fieldMatches(a2[2], (a2[2] & DYDT_BIT) ? regs[REG_DAY] : regs[REG_DATE], 0x3F))
+	{
+		regs[REG_STATUS] |= STAT_A2F;
+	}
+
+	updateInterruptPin();
+}
@@ -0,0 +1,97 @@
+/**
+ *  My Extension to some open source application
+ *
+ *  Copyright 2022 by Edward Figarsky <efigarsky@gmail.com>
+ *
+ * This file is part of an open source application.
+ *
+ * Some open source application is free software: you can redistribute
+ * it and/or modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * Some open source application is distributed in the hope that it will
+ * be useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * @license GPL-3.0+ <http://spdx.org/licenses/GPL-3.0+>
+ */
+#pragma once
+#ifndef _DS3231Model_h_
+#define _DS3231Model_h_
+
+#include "Arduino.h"
+#include "Wire.h"
+#include "HostEmulator.h"
+
+#define DS3231_MODEL_REGISTERS			0x13
+#define DS3231_MODEL_CONVERSION_MILLIS	125		// typical tCONV is 125 ms, 200 ms max
+#define DS3231_MODEL_TCXO_SECONDS		64		// automatic temperature conversion period
+
+/*
+  Register-level model of a DS3231 as seen from the I2C bus.
+
+  - BCD timekeeping with 12/24 hour modes, leap years and the century bit
+  - alarm 1 and alarm 2 matching with the A1Mx/A2Mx masks and DY/DT, setting
+    A1F/A2F and pulling INT low when INTCN and the matching AxIE are set
+  - status register write rules: A1F/A2F/OSF can only be cleared, BSY is
+    read only
+  - temperature registers refreshed every 64 s and on CONV, with BSY/CONV
+    held for the conversion time
+  - aging offset, applied as a 0.1 ppm per LSB rate error on the virtual clock
+
+  Time advances only through the host virtual clock (hostAdvanceMillis) or
+  tickSecond().
+*/
+class DS3231Model : public I2CDevice, public HostClockListener {
+public:
+	DS3231Model();
+	~DS3231Model();
+
+	void connect(TwoWire& wire, uint8_t address);
+	void disconnect(void);
+	void connectInterruptPin(uint8_t pin);
+	void powerOnReset(void);
+
+	void setAmbientTemperature(int16_t quarterDegrees) { ambient = quarterDegrees; }
+	void setConversionMillis(uint16_t ms) { conversionMillis = ms; }
+	uint8_t reg(uint8_t addr) const { return regs[addr]; }
+	bool intAsserted(void) const;
+	uint32_t secondsElapsed(void) const { return seconds; }
+
+	void tickSecond(void);
+
+	// I2CDevice
+	virtual bool receive(const uint8_t* data, uint8_t length);
+	virtual bool transmit(uint8_t* data, uint8_t quantity);
+
+	// HostClockListener
+	virtual void advance(uint32_t fromMillis, uint32_t toMillis);
+
+private:
+	void writeRegister(uint8_t addr, uint8_t val);
+	void startConversion(void);
+	void finishConversion(void);
+	void incrementTime(void);
+	void checkAlarms(void);
+	void updateInterruptPin(void);
+
+	TwoWire*	bus;
+	uint8_t		busAddress;
+	int8_t		interruptPin;
+	uint8_t		regs[DS3231_MODEL_REGISTERS];
+	uint8_t		pointer;
+	uint16_t	millisIntoSecond;
+	int32_t		driftNanos;
+	uint32_t	seconds;
+	bool		converting;
+	uint16_t	conversionLeft;
+	uint16_t	conversionMillis;
+	int16_t		ambient;
+};
+
+#endif
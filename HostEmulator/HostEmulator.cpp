@@ -0,0 +1,391 @@
+/**
+ *  My Extension to some open source application
+ *
+ *  Copyright 2022 by Edward Figarsky <efigarsky@gmail.com>
+ *
+ * This file is part of an open source application.
+ *
+ * Some open source application is free software: you can redistribute
+ * it and/or modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * Some open source application is distributed in the hope that it will
+ * be useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * @license GPL-3.0+ <http://spdx.org/licenses/GPL-3.0+>
+ */
+#include "Arduino.h"
+#include "Wire.h"
+#include "avr/sleep.h"
+
+#define HOST_MAX_LISTENERS	8
+
+volatile uint8_t ADCSRA;
+volatile uint8_t ADCSRB;
+volatile uint8_t ADMUX;
+volatile uint8_t MCUCR;
+volatile uint8_t SREG;
+
+HostSerial	Serial;
+TwoWire		Wire;
+
+/*==========================+
+|	Virtual clock			|
++==========================*/
+
+static uint32_t				hostMillis = 0;
+static HostClockListener*	hostListeners[HOST_MAX_LISTENERS];
+static uint8_t				hostListenerCount = 0;
+
+
+void hostResetClock(void)
+{
+	hostMillis = 0;
+}
+
+
+void hostAdvanceMillis(uint32_t ms)
+{
+	uint32_t from = hostMillis;
+
+	hostMillis += ms;
+	for (uint8_t i = 0; i < hostListenerCount; i++)
+	{
+		hostListeners[i]->advance(from, hostMillis);
+	}
+}
+
+
+void hostAddClockListener(HostClockListener* listener)
+{
+	if (hostListenerCount < HOST_MAX_LISTENERS)
+	{
+		hostListeners[hostListenerCount++] = listener;
+	}
+}
+
+
+void hostRemoveClockListener(HostClockListener* listener)
+{
+	for (uint8_t i = 0; i < hostListenerCount; i++)
+	{
+		if (hostListeners[i] == listener)
+		{
+			hostListeners[i] = hostListeners[--hostListenerCount];
+			return;
+		}
+	}
+}
+
+
+unsigned long millis(void)
+{
+	return hostMillis;
+}
+
+
+unsigned long micros(void)
+{
+	return hostMillis * 1000UL;
+}
+
+
+void delay(unsigned long ms)
+{
+	hostAdvanceMillis(ms);
+}
+
+
+void delayMicroseconds(unsigned int us)
+{
+}
+
+/*==========================+
+|	Pins and interrupts		|
++==========================*/
+
+static uint8_t	hostPinMode[HOST_PINS];
+static uint8_t	hostPinDriven[HOST_PINS];		// level set by the sketch (OUTPUT pins)
+static uint8_t	hostPinExternal[HOST_PINS];		// level set by the outside world + 1, 0 = released
+static uint16_t	hostAnalog[HOST_PINS];
+static void		(*hostIsr[2])(void) = { NULL, NULL };
+static uint8_t	hostIsrMode[2];
+static bool		hostSleepEnabled = false;
+
+
+void hostSetPinLevel(uint8_t pin, uint8_t level)
+{
+	if (pin < HOST_PINS)
+	{
+		hostPinExternal[pin] = (level == HOST_RELEASED) ? 0 : level + 1;
+	}
+}
+
+
+void hostSetAnalogValue(uint8_t pin, uint16_t value)
+{
+	if (pin < HOST_PINS)
+	{
+		hostAnalog[pin] = value;
+	}
+}
+
+
+void pinMode(uint8_t pin, uint8_t mode)
+{
+	if (pin < HOST_PINS)
+	{
+		hostPinMode[pin] = mode;
+	}
+}
+
+
+void digitalWrite(uint8_t pin, uint8_t val)
+{
+	if (pin < HOST_PINS)
+	{
+		hostPinDriven[pin] = val;
+	}
+}
+
+
+int digitalRead(uint8_t pin)
+{
+	if (pin >= HOST_PINS)
+	{
+		return LOW;
+	}
+	if (hostPinMode[pin] == OUTPUT)
+	{
+		return hostPinDriven[pin];
+	}
+	if (hostPinExternal[pin] == 0)
+	{
+		return (hostPinMode[pin] == INPUT_PULLUP) ? HIGH : LOW;		// nobody drives it
+	}
+	return hostPinExternal[pin] - 1;
+}
+
+
+int analogRead(uint8_t pin)
+{
+	return (pin < HOST_PINS) ? hostAnalog[pin] : 0;
+}
+
+
+void analogReference(uint8_t mode)
+{
+}
+
+
+void analogWrite(uint8_t pin, int val)
+{
+	digitalWrite(pin, (val >= 128) ? HIGH : LOW);
+}
+
+
+void attachInterrupt(uint8_t interruptNum, void (*userFunc)(void), int mode)
+{
+	if (interruptNum < 2)
+	{
+		hostIsr[interruptNum] = userFunc;
+		hostIsrMode[interruptNum] = mode;
+	}
+}
+
+
+void detachInterrupt(uint8_t interruptNum)
+{
+	if (interruptNum < 2)
+	{
+		hostIsr[interruptNum] = NULL;
+	}
+}
+
+
+// Returns true (after running the handler) if an attached LOW-level interrupt is pending
+static bool hostServiceInterrupts(void)
+{
+	for (uint8_t i = 0; i < 2; i++)
+	{
+		if (hostIsr[i] != NULL && hostIsrMode[i] == LOW && digitalRead(i + 2) == LOW)
+		{
+			void (*isr)(void) = hostIsr[i];
+			(*isr)();
+			return true;
+		}
+	}
+	return false;
+}
+
+
+void set_sleep_mode(uint8_t mode)
+{
+}
+
+
+void sleep_enable(void)
+{
+	hostSleepEnabled = true;
+}
+
+
+void sleep_disable(void)
+{
+	hostSleepEnabled = false;
+}
+
+
+// Fast-forward a second at a time until something pulls a wake pin low
+void sleep_cpu(void)
+{
+	uint32_t slept = 0;
+
+	if (!hostSleepEnabled)
+	{
+		return;
+	}
+	while (!hostServiceInterrupts() && slept < HOST_SLEEP_LIMIT_MILLIS)
+	{
+		hostAdvanceMillis(1000 - millis() % 1000);
+		slept += 1000;
+	}
+}
+
+
+char* dtostrf(double val, signed char width, unsigned char prec, char* sout)
+{
+	sprintf(sout, "%*.*f", width, prec, val);
+	return sout;
+}
+
+/*==========================+
+|	TwoWire					|
++==========================*/
+
+TwoWire::TwoWire()
+{
+	memset(devices, 0, sizeof(devices));
+	txAddress = 0;
+	txLength = 0;
+	rxIndex = 0;
+	rxLength = 0;
+	transactionCount = 0;
+}
+
+
+void TwoWire::begin(void)
+{
+	rxIndex = 0;
+	rxLength = 0;
+}
+
+
+void TwoWire::end(void)
+{
+}
+
+
+void TwoWire::setClock(uint32_t clock)
+{
+}
+
+
+void TwoWire::attach(uint8_t address, I2CDevice* device)
+{
+	devices[address & 0x7F] = device;
+}
+
+
+void TwoWire::detach(uint8_t address)
+{
+	devices[address & 0x7F] = NULL;
+}
+
+
+void TwoWire::beginTransmission(uint8_t address)
+{
+	txAddress = address & 0x7F;
+	txLength = 0;
+}
+
+
+// Same return codes as the AVR Wire: 0 ok, 2 address NAK, 3 data NAK
+uint8_t TwoWire::endTransmission(uint8_t sendStop)
+{
+	I2CDevice* device = devices[txAddress];
+
+	transactionCount++;
+	if (device == NULL)
+	{
+		return 2;
+	}
+	return device->receive(txBuffer, txLength) ? 0 : 3;
+}
+
+
+uint8_t TwoWire::requestFrom(uint8_t address, uint8_t quantity)
+{
+	I2CDevice* device = devices[address & 0x7F];
+
+	transactionCount++;
+	rxIndex = 0;
+	rxLength = 0;
+	if (quantity > BUFFER_LENGTH)
+	{
+		quantity = BUFFER_LENGTH;
+	}
+	if (device == NULL || !device->transmit(rxBuffer, quantity))
+	{
+		return 0;
+	}
+	rxLength = quantity;
+	return quantity;
+}
+
+
+size_t TwoWire::write(uint8_t data)
+{
+	if (txLength >= BUFFER_LENGTH)
+	{
+		return 0;
+	}
+	txBuffer[txLength++] = data;
+	return 1;
+}
+
+
+size_t TwoWire::write(const uint8_t* data, size_t quantity)
+{
+	size_t written = 0;
+
+	while (written < quantity && write(data[written]))
+	{
+		written++;
+	}
+	return written;
+}
+
+
+int TwoWire::available(void)
+{
+	return rxLength - rxIndex;
+}
+
+
+int TwoWire::read(void)
+{
+	return (rxIndex < rxLength) ? rxBuffer[rxIndex++] : -1;
+}
+
+
+int TwoWire::peek(void)
+{
+	return (rxIndex < rxLength) ? rxBuffer[rxIndex] : -1;
+}
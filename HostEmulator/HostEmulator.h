@@ -0,0 +1,82 @@
+/**
+ *  My Extension to some open source application
+ *
+ *  Copyright 2022 by Edward Figarsky <efigarsky@gmail.com>
+ *
+ * This file is part of an open source application.
+ *
+ * Some open source application is free software: you can redistribute
+ * it and/or modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * Some open source application is distributed in the hope that it will
+ * be useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * @license GPL-3.0+ <http://spdx.org/licenses/GPL-3.0+>
+ */
+#pragma once
+#ifndef _HostEmulator_h_
+#define _HostEmulator_h_
+
+/*
+  Linux stand-ins for the bits of the Arduino core, Wire and avr-libc that
+  ds3231.cpp, at24c32.cpp, adc_sampler.cpp, DS3231Helpers.cpp,
+  DateTimeHelpers.cpp, HourlyDataTypes.cpp, VoltageScaling.cpp,
+  VoltageFilter.cpp and StateOfCharge.cpp use, plus a controllable virtual
+  clock.  Put this directory ahead of the sketch on the include path and build
+  the modules with the host compiler:
+
+    g++ -std=gnu++11 -O2 -IHostEmulator -IBatteryMonitorControl \
+        HostEmulator/HostEmulator.cpp HostEmulator/DS3231Model.cpp \
+        HostEmulator/AT24C32Model.cpp \
+        BatteryMonitorControl/ds3231.cpp BatteryMonitorControl/at24c32.cpp \
+        BatteryMonitorControl/twi_async.cpp BatteryMonitorControl/adc_sampler.cpp \
+        BatteryMonitorControl/DS3231Helpers.cpp \
+        BatteryMonitorControl/DateTimeHelpers.cpp \
+        BatteryMonitorControl/VoltageScaling.cpp \
+        BatteryMonitorControl/VoltageFilter.cpp \
+        BatteryMonitorControl/StateOfCharge.cpp HostEmulator/HostTests.cpp
+
+  HostTests.cpp is a driver of that kind; "make check" in this directory
+  builds it (see Makefile) and runs it.
+
+  Nothing here defines __AVR__, so config.h leaves CONFIG_ASYNC_TWI off and the
+  driver talks to the simulated TwoWire below.
+
+  Time only moves when somebody moves it: hostAdvanceMillis() (and delay(),
+  which calls it) advance millis() and let every attached device model catch
+  up.  sleep_cpu() fast-forwards until an attached LOW-level interrupt pin is
+  pulled low, then runs its handler, which is how a DS3231 alarm wakes us.
+*/
+
+#include <stdint.h>
+
+#define HOST_PINS				20
+#define HOST_SLEEP_LIMIT_MILLIS	(48UL * 3600UL * 1000UL)	// sleep_cpu() gives up after two days
+
+// Anything that needs to see time pass (the RTC model) registers one of these.
+class HostClockListener {
+public:
+	virtual ~HostClockListener() {}
+	virtual void advance(uint32_t fromMillis, uint32_t toMillis) = 0;
+};
+
+void hostResetClock(void);
+void hostAdvanceMillis(uint32_t ms);
+void hostAddClockListener(HostClockListener* listener);
+void hostRemoveClockListener(HostClockListener* listener);
+
+// Pin levels driven from outside the MCU (open-drain outputs, ADC inputs).
+// A released pin reads HIGH with INPUT_PULLUP, LOW otherwise.
+#define HOST_RELEASED	0xFF
+
+void hostSetPinLevel(uint8_t pin, uint8_t level);
+void hostSetAnalogValue(uint8_t pin, uint16_t value);
+
+#endif
@@ -0,0 +1,372 @@
+/**
+ *  My Extension to some open source application
+ *
+ *  Copyright 2022 by Edward Figarsky <efigarsky@gmail.com>
+ *
+ * This file is part of an open source application.
+ *
+ * Some open source application is free software: you can redistribute
+ * it and/or modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * Some open source application is distributed in the hope that it will
+ * be useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * @license GPL-3.0+ <http://spdx.org/licenses/GPL-3.0+>
+ */
+
+/*
+  Host-side checks of the RTC path, run against DS3231Model through the
+  simulated Wire: time decoding across month, leap day and year ends, and
+  alarm 1/alarm 2 matching as setNextAlarm() and DS3231_set_a2() program them.
+  Also the hourly voltage histogram's percentiles against exact ones, and the
+  record log in the AT24C32 through AT24C32Model.
+  Build and run with "make check" in this directory (see Makefile).
+
+  Each check prints its name; a failed expectation prints where and the run
+  exits non-zero.
+*/
+
+#include <stdio.h>
+#include "Arduino.h"
+#include "Wire.h"
+#include "HostEmulator.h"
+#include "DS3231Model.h"
+#include "AT24C32Model.h"
+#include "at24c32.h"
+#include "ds3231.h"
+#include "DS3231Helpers.h"
+#include "HourlyDataTypes.h"
+
+#define RTC_ADDRESS		0x68
+#define RTC_INT_PIN		3
+
+static uint16_t failures = 0;
+
+#define EXPECT(condition)	expect((condition), #condition, __FILE__, __LINE__)
+
+static void expect(bool ok, const char* what, const char* file, int line)
+{
+	if (!ok)
+	{
+		printf("  FAILED %s:%d: %s\n", file, line, what);
+		failures++;
+	}
+}
+
+
+static DateTimeDS3231 makeTime(uint16_t year, uint8_t mon, uint8_t mday, uint8_t hour, uint8_t min, uint8_t sec, uint8_t wday)
+{
+	DateTimeDS3231 t = {};
+
+	t.year = year;
+	t.mon = mon;
+	t.mday = mday;
+	t.hour = hour;
+	t.min = min;
+	t.sec = sec;
+	t.wday = wday;
+	return t;
+}
+
+
+static bool alarmFlag(DS3231Model* rtc, uint8_t flag)
+{
+	return (rtc->reg(DS3231_STATUS_ADDR) & flag) != 0;
+}
+
+
+/*==========================+
+|	Time decoding			|
++==========================*/
+
+static void checkTimeDecoding(DS3231Model* rtc)
+{
+	DateTimeDS3231	t;
+	DateTimeDS3231	back;
+
+	printf("time decoding\n");
+
+	// Into a leap day
+	DS3231_set(makeTime(2024, 2, 28, 23, 59, 50, 3));
+	hostAdvanceMillis(20000UL);
+	DS3231_get(&t);
+	EXPECT(t.year == 2024 && t.mon == 2 && t.mday == 29);
+	EXPECT(t.hour == 0 && t.min == 0 && t.sec == 10);
+	EXPECT(t.wday == 4);
+	EXPECT(t.leapYear);
+	EXPECT(t.yday == 60);
+	EXPECT(rtc->reg(0x04) == 0x29);				// BCD date register
+
+	// Out of it, and the epoch follows
+	DS3231_set(makeTime(2024, 2, 29, 23, 59, 59, 4));
+	hostAdvanceMillis(1000UL);
+	DS3231_get(&t);
+	EXPECT(t.mon == 3 && t.mday == 1 && t.hour == 0 && t.sec == 0);
+	EXPECT(t.yday == 61);
+	DS3231_epoch_to_time(t.epoch, &back);
+	EXPECT(back.year == 2024 && back.mon == 3 && back.mday == 1 && back.hour == 0 && back.sec == 0);
+
+	// Across a year end; the epoch is seconds since 1.1.2000
+	DS3231_set(makeTime(2023, 12, 31, 23, 59, 58, 7));
+	hostAdvanceMillis(3000UL);
+	DS3231_get(&t);
+	EXPECT(t.year == 2024 && t.year_s == 24 && t.mon == 1 && t.mday == 1);
+	EXPECT(t.hour == 0 && t.min == 0 && t.sec == 1);
+	EXPECT(t.yday == 1);
+	EXPECT(t.epoch == 8766UL * 86400UL + 1);	// 2000-2023 is 24 years, 6 of them leap
+}
+
+
+/*==========================+
+|	Alarm matching			|
++==========================*/
+
+static void checkAlarmMatching(DS3231Model* rtc)
+{
+	static const uint8_t	minuteOnly[4] = { 0, 1, 1, 0 };	// A2M2..A2M4, DY/DT
+	DateTimeDS3231			t;
+
+	printf("alarm matching\n");
+
+	// Alarm 1, seconds ahead and wrapping past midnight
+	DS3231_set(makeTime(2024, 5, 31, 23, 59, 55, 5));
+	DS3231_clear_alarm_flags();
+	setNextAlarm(0, 0, 10);
+	EXPECT(rtc->reg(DS3231_ALARM1_ADDR) == 0x05 && rtc->reg(DS3231_ALARM1_ADDR + 1) == 0x00 && rtc->reg(DS3231_ALARM1_ADDR + 2) == 0x00);
+	hostAdvanceMillis(9000UL);
+	EXPECT(!alarmFlag(rtc, DS3231_STATUS_A1F));
+	EXPECT(!rtc->intAsserted());
+	hostAdvanceMillis(1000UL);
+	DS3231_get(&t);
+	EXPECT(t.mon == 6 && t.mday == 1 && t.sec == 5);
+	EXPECT(alarmFlag(rtc, DS3231_STATUS_A1F));
+	EXPECT(rtc->intAsserted());
+	EXPECT(digitalRead(RTC_INT_PIN) == LOW);
+	DS3231_clear_a1f();
+	EXPECT(!alarmFlag(rtc, DS3231_STATUS_A1F));
+	EXPECT(!rtc->intAsserted());
+
+	// It matches on h:m:s only, so it comes round again a day later and not before
+	hostAdvanceMillis(86399UL * 1000UL);
+	EXPECT(!alarmFlag(rtc, DS3231_STATUS_A1F));
+	hostAdvanceMillis(1000UL);
+	EXPECT(alarmFlag(rtc, DS3231_STATUS_A1F));
+	DS3231_clear_alarm_flags();
+
+	// Alarm 2 on the minute alone, once an hour; no A2IE, so INT stays high
+	DS3231_set(makeTime(2024, 6, 1, 10, 14, 30, 6));
+	DS3231_set_a2(15, 0, 0, minuteOnly);
+	DS3231_set_creg(DS3231_CONTROL_INTCN);
+	hostAdvanceMillis(29000UL);
+	EXPECT(!alarmFlag(rtc, DS3231_STATUS_A2F));
+	hostAdvanceMillis(1000UL);
+	EXPECT(alarmFlag(rtc, DS3231_STATUS_A2F));
+	EXPECT(!rtc->intAsserted());
+	DS3231_clear_a2f();
+	hostAdvanceMillis(59UL * 60UL * 1000UL);
+	EXPECT(!alarmFlag(rtc, DS3231_STATUS_A2F));
+	hostAdvanceMillis(60UL * 1000UL);
+	DS3231_get(&t);
+	EXPECT(t.hour == 11 && t.min == 15);
+	EXPECT(alarmFlag(rtc, DS3231_STATUS_A2F));
+	DS3231_clear_alarm_flags();
+}
+
+
+/*==========================+
+|	Hourly percentiles		|
++==========================*/
+
+#define PERCENTILE_READINGS_MAX	1800		// an hour of 2 second wakes
+
+static uint32_t	noise = 1;
+
+// Repeatable across hosts, unlike rand()
+static uint16_t nextNoise(uint16_t range)
+{
+	noise = noise * 1103515245UL + 12345UL;
+	return (noise >> 16) % range;
+}
+
+
+static uint16_t percentileReading(uint8_t hour, uint16_t i)
+{
+	switch (hour)
+	{
+	case 0:		// steady
+		return 2400 + nextNoise(41) - 20;
+	case 1:		// sat near the cutoff, then charged
+		return (i < 100) ? 2290 + nextNoise(10) : 2500 + nextNoise(20);
+	case 2:		// one dip
+		return (i == 100) ? 2270 : 2500 + nextNoise(20);
+	default:	// a slow ramp over a full hour
+		return 2300 + (uint32_t)i * 250 / PERCENTILE_READINGS_MAX;
+	}
+}
+
+
+static void checkHistogramPercentiles(void)
+{
+	static const uint8_t	percents[] = { 10, 50, 90 };
+	static uint16_t			sorted[PERCENTILE_READINGS_MAX];
+	CurrentHourData			current;
+	HourlyData				closed[1];
+	uint8_t					nodes[HourlyExtremeCount];
+	DateTimeDS3231			t = {};
+	int16_t					temp = 100;
+
+	printf("hourly percentiles\n");
+
+	for (uint8_t hour = 0; hour < 4; hour++)
+	{
+		uint16_t	readings = (hour == 3) ? PERCENTILE_READINGS_MAX : 360;
+		uint16_t	closedPercentiles[3];
+
+		SetHistogramRange(&current.vHistogram, 2260, 2580);
+		for (uint16_t i = 0; i < readings; i++)
+		{
+			uint16_t	raw = percentileReading(hour, i);
+			uint16_t	j = i;
+
+			if (i == 0)
+			{
+				PrepCurrentHour(&current, &t, &raw, &temp);
+			}
+			else
+			{
+				AddSampleToCurrentHour(&current, &t, &raw, &temp);
+			}
+			// Insertion sort, for the exact percentiles
+			for (; j > 0 && sorted[j - 1] > raw; j--)
+			{
+				sorted[j] = sorted[j - 1];
+			}
+			sorted[j] = raw;
+		}
+
+		// Within a bin while the hour is open...
+		for (uint8_t p = 0; p < 3; p++)
+		{
+			int32_t	exact = sorted[(uint32_t)readings * percents[p] / 100];
+			int32_t	live = CurrentHourPercentile(&current, percents[p]);
+
+			EXPECT(labs(live - exact) <= (1 << current.vHistogram.shift));
+		}
+
+		// ...and within a bin and an encoding step once it is closed
+		CloseCurrentHour(closed, &current, 0, nodes, 1);
+		closedPercentiles[0] = HourlyVP10(closed);
+		closedPercentiles[1] = HourlyVP50(closed);
+		closedPercentiles[2] = HourlyVP90(closed);
+		for (uint8_t p = 0; p < 3; p++)
+		{
+			int32_t	exact = sorted[(uint32_t)readings * percents[p] / 100];
+
+			EXPECT(labs(closedPercentiles[p] - exact) <= (1 << current.vHistogram.shift) + HOURLY_VOLTAGE_UNIT / 2);
+			EXPECT(closedPercentiles[p] >= HourlyVMin(closed) && closedPercentiles[p] <= HourlyVMax(closed) + HOURLY_VOLTAGE_UNIT / 2);
+		}
+		EXPECT(HourlyVMin(closed) == sorted[0]);
+	}
+}
+
+
+/*==========================+
+|	EEPROM record log		|
++==========================*/
+
+#define LOG_RECORD_SIZE		21		// as LoggedHour in the sketch
+#define LOG_RECORDS			200		// enough to wrap
+
+static void makeRecord(uint8_t* record, uint16_t n)
+{
+	for (uint8_t i = 0; i < LOG_RECORD_SIZE; i++)
+	{
+		record[i] = n + i;
+	}
+}
+
+
+static bool recordIs(const uint8_t* record, uint16_t n)
+{
+	uint8_t expected[LOG_RECORD_SIZE];
+
+	makeRecord(expected, n);
+	return memcmp(record, expected, LOG_RECORD_SIZE) == 0;
+}
+
+
+static void checkRecordLog(AT24C32Model* eeprom)
+{
+	AT24C32Log	log;
+	uint8_t		record[LOG_RECORD_SIZE];
+	uint16_t	slots;
+
+	printf("record log\n");
+
+	// A blank chip gets a header and an empty log
+	EXPECT(at24c32_log_init(&log, 0, AT24C32_SIZE, LOG_RECORD_SIZE, 1));
+	slots = log.slots;
+	EXPECT(slots == (AT24C32_SIZE - AT24C32_LOG_HEADER_SIZE) / (LOG_RECORD_SIZE + 2));
+	EXPECT(log.count == 0);
+	EXPECT(eeprom->byteAt(0) == (AT24C32_LOG_MAGIC >> 8) && eeprom->byteAt(2) == 1 && eeprom->byteAt(3) == LOG_RECORD_SIZE);
+
+	// Packed across pages, one write cycle per append (two for a slot that
+	// straddles a page), and found again after a reset once it has wrapped
+	for (uint16_t n = 0; n < LOG_RECORDS; n++)
+	{
+		uint16_t	first = AT24C32_LOG_HEADER_SIZE + log.head * (LOG_RECORD_SIZE + 2);
+		uint16_t	last = first + LOG_RECORD_SIZE + 1;
+		uint32_t	cycles = eeprom->writeCycles();
+
+		makeRecord(record, n);
+		EXPECT(at24c32_log_append(&log, record));
+		EXPECT(eeprom->writeCycles() - cycles == 1U + (first / AT24C32_PAGE_SIZE != last / AT24C32_PAGE_SIZE));
+	}
+	EXPECT(at24c32_log_init(&log, 0, AT24C32_SIZE, LOG_RECORD_SIZE, 1));
+	EXPECT(log.count == slots);
+	EXPECT(at24c32_log_read(&log, 0, record) && recordIs(record, LOG_RECORDS - 1));
+	EXPECT(at24c32_log_read(&log, slots - 1, record) && recordIs(record, LOG_RECORDS - slots));
+
+	// A record whose sequence number never made it is not taken as the newest
+	makeRecord(record, 999);
+	at24c32_write(AT24C32_LOG_HEADER_SIZE + log.head * (LOG_RECORD_SIZE + 2), record, LOG_RECORD_SIZE);
+	EXPECT(at24c32_log_init(&log, 0, AT24C32_SIZE, LOG_RECORD_SIZE, 1));
+	EXPECT(at24c32_log_read(&log, 0, record) && recordIs(record, LOG_RECORDS - 1));
+
+	// Another layout version (or record size) erases it
+	EXPECT(at24c32_log_init(&log, 0, AT24C32_SIZE, LOG_RECORD_SIZE, 2));
+	EXPECT(log.count == 0 && eeprom->byteAt(2) == 2);
+	EXPECT(eeprom->byteAt(AT24C32_LOG_HEADER_SIZE) == 0xFF && eeprom->byteAt(AT24C32_SIZE - 32) == 0xFF);
+	EXPECT(at24c32_log_init(&log, 0, AT24C32_SIZE, LOG_RECORD_SIZE - 1, 2));
+	EXPECT(log.count == 0 && eeprom->byteAt(3) == LOG_RECORD_SIZE - 1);
+	EXPECT(!at24c32_log_read(&log, 0, record));
+}
+
+
+int main()
+{
+	DS3231Model rtc;
+	AT24C32Model eeprom;
+
+	rtc.connect(Wire, RTC_ADDRESS);
+	rtc.connectInterruptPin(RTC_INT_PIN);
+	eeprom.connect(Wire, AT24C32_I2C_ADDR);
+	pinMode(RTC_INT_PIN, INPUT_PULLUP);
+	twi_async_begin();
+	DS3231_init(DS3231_CONTROL_INTCN);
+
+	checkTimeDecoding(&rtc);
+	checkAlarmMatching(&rtc);
+	checkHistogramPercentiles();
+	checkRecordLog(&eeprom);
+
+	printf(failures ? "%u FAILED\n" : "all passed\n", failures);
+	return failures ? 1 : 0;
+}
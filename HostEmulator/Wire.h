@@ -0,0 +1,77 @@
+/**
+ *  My Extension to some open source application
+ *
+ *  Copyright 2022 by Edward Figarsky <efigarsky@gmail.com>
+ *
+ * This file is part of an open source application.
+ *
+ * Some open source application is free software: you can redistribute
+ * it and/or modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * Some open source application is distributed in the hope that it will
+ * be useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * @license GPL-3.0+ <http://spdx.org/licenses/GPL-3.0+>
+ */
+#pragma once
+#ifndef _HOST_WIRE_H_
+#define _HOST_WIRE_H_
+
+#include "Arduino.h"
+
+#define BUFFER_LENGTH 32
+
+// A simulated I2C slave.  A write transaction hands over everything that was
+// queued between beginTransmission() and endTransmission(); a read asks for
+// quantity bytes.  Returning false NAKs the transaction.
+class I2CDevice {
+public:
+	virtual ~I2CDevice() {}
+	virtual bool receive(const uint8_t* data, uint8_t length) = 0;
+	virtual bool transmit(uint8_t* data, uint8_t quantity) = 0;
+};
+
+class TwoWire {
+public:
+	TwoWire();
+	void begin(void);
+	void end(void);
+	void setClock(uint32_t clock);
+	void beginTransmission(uint8_t address);
+	void beginTransmission(int address) { beginTransmission((uint8_t)address); }
+	uint8_t endTransmission(uint8_t sendStop);
+	uint8_t endTransmission(void) { return endTransmission(true); }
+	uint8_t requestFrom(uint8_t address, uint8_t quantity);
+	uint8_t requestFrom(int address, int quantity) { return requestFrom((uint8_t)address, (uint8_t)quantity); }
+	size_t write(uint8_t data);
+	size_t write(const uint8_t* data, size_t quantity);
+	int available(void);
+	int read(void);
+	int peek(void);
+
+	// emulator side
+	void attach(uint8_t address, I2CDevice* device);
+	void detach(uint8_t address);
+	uint32_t transactions(void) const { return transactionCount; }
+
+private:
+	I2CDevice*	devices[128];
+	uint8_t		txAddress;
+	uint8_t		txBuffer[BUFFER_LENGTH];
+	uint8_t		txLength;
+	uint8_t		rxBuffer[BUFFER_LENGTH];
+	uint8_t		rxIndex;
+	uint8_t		rxLength;
+	uint32_t	transactionCount;
+};
+
+extern TwoWire Wire;
+
+#endif
@@ -0,0 +1,5 @@
+// Host stand-in: no interrupt controller, so these are no-ops.
+#pragma once
+
+#define cli()
+#define sei()
@@ -0,0 +1,20 @@
+// Host stand-in: the special function registers the sketch touches are plain
+// variables here, so writes are harmless and reads see the last write.
+#pragma once
+#include <stdint.h>
+
+extern volatile uint8_t ADCSRA;
+extern volatile uint8_t ADCSRB;
+extern volatile uint8_t ADMUX;
+extern volatile uint8_t MCUCR;
+extern volatile uint8_t SREG;
+
+#define _BV(bit)	(1 << (bit))
+
+#define BODSE	5
+#define BODS	6
+
+#define ADEN	7
+#define ADPS2	2
+#define ADPS1	1
+#define ADPS0	0
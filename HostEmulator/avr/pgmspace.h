@@ -0,0 +1,13 @@
+// Host stand-in: flash and RAM are the same thing here.
+#pragma once
+#include <stdint.h>
+#include <string.h>
+
+#ifndef PROGMEM
+ #define PROGMEM
+#endif
+#define PSTR(s)					(s)
+#define pgm_read_byte(addr)		(*(const uint8_t *)(addr))
+#define pgm_read_word(addr)		(*(const uint16_t *)(addr))
+#define pgm_read_dword(addr)	(*(const uint32_t *)(addr))
+#define memcpy_P				memcpy
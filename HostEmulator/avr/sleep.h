@@ -0,0 +1,15 @@
+// Host stand-in: sleep_cpu() fast-forwards the virtual clock until a wake
+// interrupt fires (see HostEmulator.h).
+#pragma once
+
+#define SLEEP_MODE_IDLE			0
+#define SLEEP_MODE_ADC			1
+#define SLEEP_MODE_PWR_DOWN		2
+#define SLEEP_MODE_PWR_SAVE		3
+#define SLEEP_MODE_STANDBY		6
+#define SLEEP_MODE_EXT_STANDBY	7
+
+void set_sleep_mode(uint8_t mode);
+void sleep_enable(void);
+void sleep_disable(void);
+void sleep_cpu(void);
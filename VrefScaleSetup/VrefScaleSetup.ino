@@ -7,6 +7,8 @@
 #include <EEPROM.h>
 #include <LiquidCrystal.h>
 #include "LCDHelper.h"
+#include "adc_sampler.h"
+#include "VoltageScaling.h"
 
 
 
@@ -92,8 +94,10 @@ void delay1(unsigned long ms);
 void setup() {
 #ifdef USE_EXTERNALVREF
 	analogReference(EXTERNAL);
+	adc_sampler_begin(EXTERNAL);
 #else
 	analogReference(DEFAULT);
+	adc_sampler_begin(DEFAULT);
 #endif
 
 	// Start LCD and Serial
@@ -124,7 +128,7 @@ void setup() {
 
 // the loop function runs over and over again until power down or reset
 void loop() {
-	uint16_t		rawVoltageSample;
+	float			rawVoltageSample;
 	float			scaledVoltage;
 
 	// Just blink LED twice to show we're running
@@ -188,7 +192,7 @@ void loop() {
 		lcd.setCursor(0, 3);
 		lcd.write((modeSwitchValue == 0) ? (byte)LCD_DOWN_ARROW : (byte)LCD_UP_ARROW);
 
-		rawVoltageSample = round(GetAverageRawVoltage(V5_SENSOR, 3, 5));
+		rawVoltageSample = GetAverageRawVoltage(V5_SENSOR, 3, 1);
 		scaledVoltage = rawVoltageSample * VREFSCALE(vDivScale);
 
 		DisplayCurrentStatus(vDivScale, rawVoltageSample, scaledVoltage);
@@ -263,14 +267,19 @@ void doBlink(uint8_t ledPin) {
 }
 
 
+// Each sample is read the way the monitor reads the battery: oversampled to
+// 10 + VOLTAGE_EXTRA_BITS bits, timed and dithered with the CPU running, so
+// the scale found here holds for its readings.  Quiet mode would calibrate
+// against a less noisy ADC than the monitor sees, and decimation needs that
+// noise.  Returned in 10 bit counts, with the extra bits as the fraction.
 float GetAverageRawVoltage(uint8_t voltagePin, uint8_t samples, uint16_t delayMillis) {
-	int32_t rawVoltageSum = 0;
-	uint8_t i;
-	for (i = 0; i < samples; i++) {
-		delay1(delayMillis);
-		rawVoltageSum += analogRead(voltagePin);
+	uint32_t rawVoltageSum = 0;
+
+	for (uint8_t i = 0; i < samples; i++) {
+		rawVoltageSum += adc_sampler_oversample(voltagePin, VOLTAGE_EXTRA_BITS, (delayMillis == 0) ? 1000 : 1000 / delayMillis, ADC_SAMPLER_TIMED | ADC_SAMPLER_DITHER);
 	}
-	return rawVoltageSum / static_cast<float>(samples);
+
+	return rawVoltageSum / static_cast<float>(samples) / (1 << VOLTAGE_EXTRA_BITS);
 }
 
 